@@ -50,6 +50,7 @@
 #include "logical-or.h"
 #include "logical-xor.h"
 #include "map.h"
+#include "modbus-read.h"
 #include "ni1000tk5000.h"
 #include "pd.h"
 #include "pt1000.h"
@@ -179,6 +180,10 @@ static struct pcs_map loaders[] = {
 		.key		= "logical XOR",
 		.value		= load_logical_xor_builder,
 	}
+	,{
+		.key		= "modbus read",
+		.value		= load_modbus_read_builder,
+	}
 	,{
 		.key		= "ni1000tk5000",
 		.value		= load_ni1000tk5000_builder,
@@ -32,12 +32,27 @@ struct block {
 	struct block_builder	*builder;
 	const char		**outputs_table;
 	long			*outputs;
+	unsigned int		outputs_count;
 	unsigned int		multiple;
 	unsigned int		counter;
+	int			phase;
+	int			priority;
+	unsigned int		index;
+	unsigned int		level;
+	unsigned int		deps_count;
+	struct block		**deps;
+#ifdef PCS_PROFILE
+	struct profile		profile;
+#endif
 	void			*data;
 };
 
+/*
+ * prepare is optional. It is called for every block due in a tick
+ * before any of them runs.
+ */
 struct block_ops {
+	void	(*prepare)(struct block *b, struct server_state *s);
 	void	(*run)(struct block *b, struct server_state *s);
 };
 #endif
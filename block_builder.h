@@ -22,6 +22,15 @@
 
 #include "block.h"
 
+/* The block reads or writes something besides the register file */
+#define PCS_BLOCK_IO		0x00000001
+/* The block writes to registers it gets as inputs */
+#define PCS_BLOCK_WRITES_INPUTS	0x00000002
+/* The block only acquires inputs from hardware into its outputs */
+#define PCS_BLOCK_INPUT		0x00000004
+/* The block only submits requests to a serial bus queue */
+#define PCS_BLOCK_SERIAL	0x00000008
+
 struct block_builder {
 	void			*(*alloc)(void);
 	struct block_ops	*(*ops)(struct block *);
@@ -29,5 +38,6 @@ struct block_builder {
 	struct pcs_map		*inputs;
 	struct pcs_map		*strings;
 	const char		**outputs;
+	unsigned int		flags;
 };
 #endif
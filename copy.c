@@ -90,6 +90,7 @@ static struct block_builder builder = {
 	.alloc		= alloc,
 	.ops		= init,
 	.inputs		= inputs,
+	.flags		= PCS_BLOCK_WRITES_INPUTS,
 };
 
 struct block_builder *
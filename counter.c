@@ -183,6 +183,7 @@ static struct block_builder builder = {
 	.ops		= init,
 	.outputs	= outputs,
 	.strings	= strings,
+	.flags		= PCS_BLOCK_IO,
 };
 
 struct block_builder *
@@ -0,0 +1,132 @@
+/* dcon-bench.c -- measure DCON exchange throughput and latency
+ * Copyright (C) 2014 Sergey Yanovich <ynvich@gmail.com>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 2 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public
+ * License along with this program; if not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+ * Boston, MA 02111-1307, USA.
+ */
+
+#include "includes.h"
+
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "icpdas.h"
+#include "pcs-clock.h"
+
+#define MAX_RESPONSE	256
+
+static void
+usage(int err)
+{
+	fprintf(stderr, "Usage: dcon-bench [-d] [-n count] [-p port] "
+			"[-r root] slot...\n");
+	fprintf(stderr, "       dcon-bench  -h\n");
+	exit(err);
+}
+
+static int
+cmp_long(const void *a, const void *b)
+{
+	long x = *(const long *) a, y = *(const long *) b;
+
+	return x < y ? -1 : x > y;
+}
+
+/*
+ * Reads every slot in turn with the command its module answers, and
+ * prints the exchange rate and the latency distribution. Exits with an
+ * error if any exchange failed.
+ */
+int
+main(int argc, char **argv)
+{
+	const char *device = "/dev/ttyS1";
+	const char *cmds[9];
+	unsigned int slots[9], count = 1000, errors = 0, nslots = 0, i;
+	int log_level = LOG_NOTICE;
+	struct timespec start, t0, t1;
+	char data[MAX_RESPONSE];
+	long *samples, total;
+	char *bad;
+	int opt;
+
+	while ((opt = getopt(argc, argv, "dhn:p:r:")) != -1) {
+		switch (opt) {
+		case 'd':
+			if (log_level >= LOG_DEBUG)
+				log_level++;
+			else
+				log_level = LOG_DEBUG;
+			break;
+		case 'h':
+			usage(0);
+			break;
+		case 'n':
+			count = strtoul(optarg, &bad, 10);
+			if (bad[0] != 0 || !count) {
+				fprintf(stderr, "Bad count %s\n", optarg);
+				exit(1);
+			}
+			break;
+		case 'p':
+			device = optarg;
+			break;
+		case 'r':
+			icpdas_sysfs_set_root(optarg);
+			break;
+		default:
+			usage(1);
+			break;
+		}
+	}
+	if (optind == argc || argc - optind > 8)
+		usage(1);
+
+	log_init("dcon-bench", log_level, LOG_DAEMON, 1);
+
+	for (i = optind; i < argc; i++) {
+		slots[nslots] = strtoul(argv[i], &bad, 10);
+		if (bad[0] != 0 || !slots[nslots] || slots[nslots] > 8) {
+			fprintf(stderr, "Bad slot value %s\n", argv[i]);
+			exit(1);
+		}
+		if (0 > icpdas_serial_exchange(device, slots[nslots], "$00M",
+					MAX_RESPONSE, data))
+			fatal("no module in slot %u\n", slots[nslots]);
+		cmds[nslots] = strcmp(data, "!0087040") ? "#00" : "@00";
+		nslots++;
+	}
+
+	samples = xcalloc(count, sizeof(*samples));
+	pcs_clock_now(&start);
+	for (i = 0; i < count; i++) {
+		pcs_clock_now(&t0);
+		if (0 > icpdas_serial_exchange(device, slots[i % nslots],
+					cmds[i % nslots], MAX_RESPONSE, data))
+			errors++;
+		pcs_clock_now(&t1);
+		samples[i] = pcs_clock_diff(&t1, &t0);
+	}
+	total = pcs_clock_diff(&t1, &start);
+
+	qsort(samples, count, sizeof(*samples), cmp_long);
+	printf("%u exchanges, %u errors, %.1f per second\n", count, errors,
+			count * 1000000.0 / (total ? total : 1));
+	printf("latency usec: p50 %li, p90 %li, p99 %li, max %li\n",
+			samples[count / 2], samples[count * 90 / 100],
+			samples[count * 99 / 100], samples[count - 1]);
+	return errors ? 1 : 0;
+}
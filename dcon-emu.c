@@ -0,0 +1,247 @@
+/* dcon-emu.c -- emulate DCON modules on a pseudo-terminal
+ * Copyright (C) 2014 Sergey Yanovich <ynvich@gmail.com>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 2 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public
+ * License along with this program; if not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+ * Boston, MA 02111-1307, USA.
+ */
+
+#define _GNU_SOURCE
+#include "includes.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <termios.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "icpdas.h"
+
+#define MAX_RESPONSE	256
+
+/*
+ * The emulator prints the name of its pseudo-terminal and answers DCON
+ * commands on it as the simulated modules given on the command line. A
+ * reply is written after the time the command and the reply take on the
+ * wire, plus the module delay.
+ *
+ * With a root directory, the emulator creates backplane/slot_count and
+ * backplane/active_slot there, and reads the active slot before every
+ * command. Point icpdas at the same root to select slots as on the
+ * controller. Without a root, the first module answers every command.
+ */
+static void
+usage(int err)
+{
+	fprintf(stderr, "Usage: dcon-emu [-d] [-b baud] [-j usec] [-l usec] "
+			"[-r root] slot:model...\n");
+	fprintf(stderr, "       dcon-emu  -h\n");
+	exit(err);
+}
+
+static int
+write_file(const char *root, const char *name, const char *data)
+{
+	char path[256];
+	int fd, err;
+
+	snprintf(path, sizeof(path), "%s/%s", root, name);
+	fd = open(path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+	if (0 > fd) {
+		error("%s: %s (%i)\n", path, strerror(errno), errno);
+		return -1;
+	}
+	err = write(fd, data, strlen(data));
+	close(fd);
+	return 0 > err ? -1 : 0;
+}
+
+static int
+make_root(const char *root)
+{
+	char path[256];
+
+	snprintf(path, sizeof(path), "%s/backplane", root);
+	if ((mkdir(root, 0755) && EEXIST != errno) ||
+			(mkdir(path, 0755) && EEXIST != errno)) {
+		error("%s: %s (%i)\n", path, strerror(errno), errno);
+		return -1;
+	}
+	if (write_file(root, "backplane/slot_count", "8\n") ||
+			write_file(root, "backplane/active_slot", "0\n"))
+		return -1;
+	snprintf(path, sizeof(path), "%s/backplane/active_slot", root);
+	return open(path, O_RDONLY);
+}
+
+static unsigned int
+active_slot(int fd, unsigned int fallback)
+{
+	char buff[8];
+	int err;
+
+	if (0 > fd)
+		return fallback;
+	err = pread(fd, buff, sizeof(buff) - 1, 0);
+	if (0 >= err)
+		return 0;
+	buff[err] = 0;
+	return strtoul(buff, NULL, 10);
+}
+
+/* Each channel reads slot * 1000 + channel, so replies are easy to check */
+static int
+add_module(const char *arg)
+{
+	char *model;
+	unsigned long slot;
+	unsigned int i;
+	char value[16];
+
+	slot = strtoul(arg, &model, 10);
+	if (':' != *model || icpdas_sim_set_model(slot, model + 1))
+		return -1;
+	for (i = 0; i < 8; i++) {
+		snprintf(value, sizeof(value), "%lu", slot * 1000 + i);
+		icpdas_sim_set_signal(slot, i, value);
+	}
+	icpdas_sim_set_inputs(slot, 0x5a00 | slot);
+	return slot;
+}
+
+static void
+pace(long usec)
+{
+	struct timespec ts = {
+		.tv_sec		= usec / 1000000,
+		.tv_nsec	= (usec % 1000000) * 1000,
+	};
+
+	while (nanosleep(&ts, &ts) && EINTR == errno)
+		;
+}
+
+int
+main(int argc, char **argv)
+{
+	const char *root = NULL;
+	int log_level = LOG_NOTICE;
+	long baud = 115200, delay = 0, jitter = 0;
+	unsigned int first = 0, slot;
+	struct termios options;
+	char cmd[MAX_RESPONSE], reply[MAX_RESPONSE + 1];
+	int opt, master, slave, slot_fd = -1, len = 0, n, i;
+	long latency;
+	char *end;
+
+	while ((opt = getopt(argc, argv, "b:dhj:l:r:")) != -1) {
+		switch (opt) {
+		case 'b':
+			baud = strtol(optarg, NULL, 10);
+			break;
+		case 'd':
+			if (log_level >= LOG_DEBUG)
+				log_level++;
+			else
+				log_level = LOG_DEBUG;
+			break;
+		case 'h':
+			usage(0);
+			break;
+		case 'j':
+			jitter = strtol(optarg, NULL, 10);
+			break;
+		case 'l':
+			delay = strtol(optarg, NULL, 10);
+			break;
+		case 'r':
+			root = optarg;
+			break;
+		default:
+			usage(1);
+			break;
+		}
+	}
+	if (optind == argc)
+		usage(1);
+
+	log_init("dcon-emu", log_level, LOG_DAEMON, 1);
+	icpdas_io_setup("simulator", NULL, NULL);
+	for (i = optind; i < argc; i++) {
+		n = add_module(argv[i]);
+		if (0 > n)
+			fatal("bad module %s\n", argv[i]);
+		if (!first)
+			first = n;
+		icpdas_sim_set_latency(n, delay);
+		icpdas_sim_set_jitter(n, jitter);
+	}
+	if (root) {
+		slot_fd = make_root(root);
+		if (0 > slot_fd)
+			fatal("failed to set up %s\n", root);
+	}
+
+	master = posix_openpt(O_RDWR | O_NOCTTY);
+	if (0 > master || grantpt(master) || unlockpt(master))
+		fatal("pseudo-terminal: %s (%i)\n", strerror(errno), errno);
+
+	/* Keep the line raw and open while clients come and go */
+	slave = open(ptsname(master), O_RDWR | O_NOCTTY);
+	if (0 > slave || tcgetattr(slave, &options))
+		fatal("%s: %s (%i)\n", ptsname(master), strerror(errno),
+				errno);
+	cfmakeraw(&options);
+	tcsetattr(slave, TCSANOW, &options);
+
+	printf("%s\n", ptsname(master));
+	fflush(stdout);
+
+	while (1) {
+		n = read(master, &cmd[len], sizeof(cmd) - 1 - len);
+		if (0 > n && EINTR == errno)
+			continue;
+		if (0 >= n)
+			fatal("%s: %s (%i)\n", ptsname(master),
+					strerror(errno), errno);
+		len += n;
+		while ((end = memchr(cmd, 13, len))) {
+			*end = 0;
+			slot = active_slot(slot_fd, first);
+			latency = 0;
+			n = icpdas_sim_answer(slot, cmd, reply, MAX_RESPONSE,
+					&latency);
+			debug("slot%u: %s -> %s\n", slot, cmd,
+					0 < n ? reply : "");
+			if (baud)
+				latency += (end - cmd + 1 + (0 < n ? n + 1 : 0))
+					* 10 * 1000000L / baud;
+			if (0 < n) {
+				pace(latency);
+				reply[n++] = 13;
+				if (n != write(master, reply, n))
+					error("%s: %s (%i)\n", ptsname(master),
+							strerror(errno), errno);
+			}
+			len -= end + 1 - cmd;
+			memmove(cmd, end + 1, len);
+		}
+		if (len == sizeof(cmd) - 1)
+			len = 0;
+	}
+	return 0;
+}
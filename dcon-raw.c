@@ -19,46 +19,226 @@
 
 #include "includes.h"
 
+#include <errno.h>
 #include <stdio.h>
+#include <string.h>
 #include <unistd.h>
 
 #include "icpdas.h"
+#include "pcs-clock.h"
 
 #define MAX_RESPONSE	256
+#define MAX_LINE	256
+#define HISTOGRAM_SIZE	32
+#define HISTOGRAM_BAR	40
 
 static void
 usage(int err)
 {
-	fprintf(stderr, "Usage: dcon-raw [-d] [-p port] [-s slot] command\n");
+	fprintf(stderr, "Usage: dcon-raw [-d] [-p port] [-r root] [-s slot] "
+			"command\n");
+	fprintf(stderr, "       dcon-raw [-d] [-p port] [-r root] [-s slot] "
+			"[-n count] -b | -f file\n");
 	fprintf(stderr, "       dcon-raw  -h\n");
 	exit(err);
 }
 
+/*
+ * In batch mode every line is "[slot:]command [count]". The command
+ * goes to the slot, or to the -s slot, count times, or -n times. Each
+ * line gets a summary of its round-trip times, and a histogram of all
+ * of them follows.
+ */
+struct batch {
+	const char		*device;
+	unsigned int		slot;
+	unsigned int		repeat;
+	unsigned int		errors;
+	unsigned int		count;
+	unsigned int		size;
+	long			*samples;
+	unsigned long		histogram[HISTOGRAM_SIZE];
+};
+
+static int
+cmp_long(const void *a, const void *b)
+{
+	long x = *(const long *) a, y = *(const long *) b;
+
+	return x < y ? -1 : x > y;
+}
+
+static void
+print_latency(long *samples, unsigned int count)
+{
+	qsort(samples, count, sizeof(*samples), cmp_long);
+	printf("min %li, p50 %li, p90 %li, p99 %li, max %li usec\n",
+			samples[0], samples[count / 2],
+			samples[count * 90 / 100], samples[count * 99 / 100],
+			samples[count - 1]);
+}
+
+static void
+record(struct batch *b, long usec)
+{
+	unsigned int i;
+
+	if (b->count == b->size) {
+		b->size = b->size ? b->size * 2 : 1024;
+		b->samples = xrealloc(b->samples, b->size, sizeof(*b->samples));
+	}
+	b->samples[b->count++] = usec;
+	for (i = 0; i < HISTOGRAM_SIZE - 1 && usec >> (i + 1); i++)
+		;
+	b->histogram[i]++;
+}
+
+static int
+run_line(struct batch *b, char *line)
+{
+	char cmd[MAX_LINE], data[MAX_RESPONSE], reply[MAX_RESPONSE] = "";
+	unsigned int slot = b->slot, repeat = b->repeat, errors = 0, i;
+	unsigned int first = b->count;
+	struct timespec t0, t1;
+	char *p = line;
+	int n;
+
+	while (' ' == *p || '\t' == *p)
+		p++;
+	if (0 == *p || '\n' == *p)
+		return 0;
+	if (*p >= '0' && *p <= '9' && strchr(p, ':')) {
+		slot = strtoul(p, &p, 10);
+		if (':' != *p++ || slot > 8)
+			return -1;
+	}
+	n = sscanf(p, "%255s %u", cmd, &repeat);
+	if (1 > n || !repeat)
+		return -1;
+
+	for (i = 0; i < repeat; i++) {
+		pcs_clock_now(&t0);
+		n = icpdas_serial_exchange(b->device, slot, cmd, MAX_RESPONSE,
+				data);
+		pcs_clock_now(&t1);
+		if (0 > n) {
+			errors++;
+			continue;
+		}
+		record(b, pcs_clock_diff(&t1, &t0));
+		memcpy(reply, data, n + 1);
+	}
+	b->errors += errors;
+
+	printf("%u:%s x%u: %u errors", slot, cmd, repeat, errors);
+	if (b->count > first) {
+		printf(", ");
+		print_latency(&b->samples[first], b->count - first);
+		printf("  %s\n", reply);
+	} else {
+		printf("\n");
+	}
+	return 0;
+}
+
+static void
+print_histogram(const struct batch *b)
+{
+	unsigned long most = 0;
+	unsigned int i, lo = HISTOGRAM_SIZE, hi = 0;
+	char bar[HISTOGRAM_BAR + 1];
+
+	for (i = 0; i < HISTOGRAM_SIZE; i++) {
+		if (!b->histogram[i])
+			continue;
+		if (lo > i)
+			lo = i;
+		hi = i;
+		if (most < b->histogram[i])
+			most = b->histogram[i];
+	}
+	for (i = lo; i <= hi; i++) {
+		memset(bar, '#', HISTOGRAM_BAR);
+		bar[b->histogram[i] * HISTOGRAM_BAR / most] = 0;
+		printf("%8lu - %8lu usec |%-*s %lu\n", i ? 1UL << i : 0,
+				(2UL << i) - 1, HISTOGRAM_BAR, bar,
+				b->histogram[i]);
+	}
+}
+
+static int
+run_batch(struct batch *b, FILE *f)
+{
+	struct timespec start, end;
+	char line[MAX_LINE];
+	unsigned int n = 0;
+	long total;
+
+	pcs_clock_now(&start);
+	while (fgets(line, sizeof(line), f)) {
+		n++;
+		if (run_line(b, line))
+			fatal("bad command at line %u\n", n);
+	}
+	pcs_clock_now(&end);
+	total = pcs_clock_diff(&end, &start);
+
+	printf("total %u exchanges, %u errors, %.1f per second\n",
+			b->count + b->errors, b->errors,
+			(b->count + b->errors) * 1000000.0 / (total ? total : 1));
+	if (b->count) {
+		printf("latency ");
+		print_latency(b->samples, b->count);
+		print_histogram(b);
+	}
+	return b->errors ? 1 : 0;
+}
+
 int
 main(int argc, char **argv)
 {
 	const char *device = "/dev/ttyS1";
+	const char *file = NULL;
 	int log_level = LOG_NOTICE;
-	unsigned int slot = 0;
+	unsigned int slot = 0, repeat = 1;
+	struct batch b;
 	char *bad;
-	int opt;
+	int opt, batch = 0;
 	char data[MAX_RESPONSE];
 	int err;
+	FILE *f;
 
-	while ((opt = getopt(argc, argv, "dhp:s:")) != -1) {
+	while ((opt = getopt(argc, argv, "bdf:hn:p:r:s:")) != -1) {
 		switch (opt) {
+		case 'b':
+			batch = 1;
+			break;
 		case 'd':
 			if (log_level >= LOG_DEBUG)
 				log_level++;
 			else
 				log_level = LOG_DEBUG;
 			break;
+		case 'f':
+			batch = 1;
+			file = optarg;
+			break;
 		case 'h':
 			usage(0);
 			break;
+		case 'n':
+			repeat = (unsigned int) strtoul(optarg, &bad, 10);
+			if (bad[0] != 0 || !repeat) {
+				fprintf(stderr, "Bad count %s\n", optarg);
+				exit(1);
+			}
+			break;
 		case 'p':
 			device = optarg;
 			break;
+		case 'r':
+			icpdas_sysfs_set_root(optarg);
+			break;
 		case 's':
 			slot = (unsigned int) strtoul(optarg, &bad, 10);
 			if (bad[0] != 0) {
@@ -72,8 +252,22 @@ main(int argc, char **argv)
 		}
 	}
 
+	if (batch ? optind != argc : optind != argc - 1)
+		usage(1);
+
 	log_init("icp-raw", log_level, LOG_DAEMON, 1);
 
+	if (batch) {
+		f = file ? fopen(file, "r") : stdin;
+		if (!f)
+			fatal("%s: %s (%i)\n", file, strerror(errno), errno);
+		memset(&b, 0, sizeof(b));
+		b.device = device;
+		b.slot = slot;
+		b.repeat = repeat;
+		return run_batch(&b, f);
+	}
+
 	err = icpdas_serial_exchange(device, slot, argv[argc - 1],
 			MAX_RESPONSE, data);
 	if (0 > err) {
@@ -276,6 +276,7 @@ static struct block_builder builder = {
 	.ops		= init,
 	.setpoints	= setpoints,
 	.strings	= strings,
+	.flags		= PCS_BLOCK_IO,
 };
 
 struct block_builder *
@@ -159,6 +159,7 @@ static struct block_builder builder = {
 	.ops		= init,
 	.inputs		= inputs,
 	.strings	= strings,
+	.flags		= PCS_BLOCK_IO,
 };
 
 struct block_builder *
@@ -23,6 +23,7 @@
 #include "i-8024.h"
 #include "icpdas.h"
 #include "map.h"
+#include "shadow.h"
 #include "state.h"
 
 #define PCS_BLOCK	"i-8024"
@@ -32,6 +33,7 @@ struct i_8024_out_state {
 	unsigned		reset;
 	unsigned		reset_counter;
 	long			*AO[4];
+	struct shadow		shadow[4];
 };
 
 static void
@@ -46,6 +48,8 @@ i_8024_out_run(struct block *b, struct server_state *s)
 			err = icpdas_reset_parallel_analog_output(d->slot);
 			if (0 > err)
 				error("%s: i-8024 output error %i\n", b->name, err);
+			for (i = 0; i < 4; i++)
+				shadow_invalidate(&d->shadow[i]);
 		} else {
 			d->reset_counter--;
 		}
@@ -54,9 +58,14 @@ i_8024_out_run(struct block *b, struct server_state *s)
 	for (i = 0; i < 4; i++) {
 		if (NULL == d->AO[i])
 			continue;
-		err = icpdas_set_parallel_analog_output(d->slot, i, *d->AO[i]);
-		if (0 > err)
+		if (!shadow_update(&d->shadow[i], *d->AO[i]))
+			continue;
+		err = icpdas_stage_parallel_analog_output(d->slot, i,
+				*d->AO[i], &d->shadow[i]);
+		if (0 > err) {
 			error("%s: i-8024 output error %i\n", b->name, err);
+			shadow_invalidate(&d->shadow[i]);
+		}
 	}
 }
 
@@ -78,6 +87,20 @@ set_reset(void *data, const char const *key, long value)
 	return 0;
 }
 
+static int
+set_refresh(void *data, const char const *key, long value)
+{
+	struct i_8024_out_state *d = data;
+	int i;
+
+	if (value < 0)
+		return 1;
+	for (i = 0; i < 4; i++)
+		shadow_init(&d->shadow[i], value);
+	debug("refresh = %li\n", value);
+	return 0;
+}
+
 static void
 set_input(void *data, const char const *key, long *input)
 {
@@ -94,6 +117,10 @@ static struct pcs_map out_setpoints[] = {
 		.key			= "slot",
 		.value			= set_out_slot,
 	}
+	,{
+		.key			= "refresh",
+		.value			= set_refresh,
+	}
 	,{
 		.key			= "reset",
 		.value			= set_reset,
@@ -112,7 +139,12 @@ static struct pcs_map out_inputs[] = {
 static void *
 i_8024_out_alloc(void)
 {
-	return xzalloc(sizeof(struct i_8024_out_state));
+	struct i_8024_out_state *d = xzalloc(sizeof(struct i_8024_out_state));
+	int i;
+
+	for (i = 0; i < 4; i++)
+		shadow_init(&d->shadow[i], PCS_SHADOW_REFRESH);
+	return d;
 }
 
 static struct block_ops i_8024_out_ops = {
@@ -122,6 +154,9 @@ static struct block_ops i_8024_out_ops = {
 static struct block_ops *
 i_8024_out_init(struct block *b)
 {
+	struct i_8024_out_state *d = b->data;
+
+	icpdas_expect_module(NULL, d->slot, "8024");
 	return &i_8024_out_ops;
 }
 
@@ -130,6 +165,7 @@ static struct block_builder i_8024_out_builder = {
 	.ops		= i_8024_out_init,
 	.setpoints	= out_setpoints,
 	.inputs		= out_inputs,
+	.flags		= PCS_BLOCK_IO,
 };
 
 struct block_builder *
@@ -23,6 +23,7 @@
 #include "i-8041.h"
 #include "icpdas.h"
 #include "map.h"
+#include "shadow.h"
 #include "state.h"
 
 #define PCS_BLOCK	"i-8041"
@@ -30,33 +31,35 @@
 struct i_8041_out_state {
 	unsigned		slot;
 	long			*DO[32];
+	struct shadow		shadow;
 };
 
 static void
 i_8041_out_run(struct block *b, struct server_state *s)
 {
 	struct i_8041_out_state *d = b->data;
-	unsigned long state = 0;
-	unsigned long do32 = 0;
+	unsigned long do32 = 0, mask = 0;
 	int err, i;
 
-	err = icpdas_get_parallel_output(d->slot, &state);
-	if (0 > err) {
-		error("%s: i-8041 read error %i\n", b->name, err);
-		state = 0;
-	}
-
+	/* Bits without inputs keep their value, another block may own them */
 	for (i = 31; i >= 0; i--) {
-		if (NULL != d->DO[i])
+		if (NULL != d->DO[i]) {
 			do32 |= (*d->DO[i]) & 1;
-		else
-			do32 |= (state >> i) & 1;
-		if (i > 0)
+			mask |= 1;
+		}
+		if (i > 0) {
 			do32 <<= 1;
+			mask <<= 1;
+		}
 	}
-	err = icpdas_set_parallel_output(d->slot, do32);
-	if (0 > err)
+	if (!shadow_update(&d->shadow, do32))
+		return;
+
+	err = icpdas_stage_parallel_output(d->slot, do32, mask, &d->shadow);
+	if (0 > err) {
 		error("%s: i-8041 output error %i\n", b->name, err);
+		shadow_invalidate(&d->shadow);
+	}
 
 	debug3("%s: i-8041 do 0x%08lx\n",
 			b->name, do32);
@@ -71,6 +74,18 @@ set_out_slot(void *data, const char const *key, long value)
 	return 0;
 }
 
+static int
+set_refresh(void *data, const char const *key, long value)
+{
+	struct i_8041_out_state *d = data;
+
+	if (value < 0)
+		return 1;
+	shadow_init(&d->shadow, value);
+	debug("refresh = %li\n", value);
+	return 0;
+}
+
 static void
 set_input(void *data, const char const *key, long *input)
 {
@@ -84,6 +99,10 @@ set_input(void *data, const char const *key, long *input)
 
 static struct pcs_map out_setpoints[] = {
 	{
+		.key			= "refresh",
+		.value			= set_refresh,
+	}
+	,{
 		.key			= "slot",
 		.value			= set_out_slot,
 	}
@@ -101,7 +120,10 @@ static struct pcs_map out_inputs[] = {
 static void *
 i_8041_out_alloc(void)
 {
-	return xzalloc(sizeof(struct i_8041_out_state));
+	struct i_8041_out_state *d = xzalloc(sizeof(struct i_8041_out_state));
+
+	shadow_init(&d->shadow, PCS_SHADOW_REFRESH);
+	return d;
 }
 
 static struct block_ops i_8041_out_ops = {
@@ -111,6 +133,9 @@ static struct block_ops i_8041_out_ops = {
 static struct block_ops *
 i_8041_out_init(struct block *b)
 {
+	struct i_8041_out_state *d = b->data;
+
+	icpdas_expect_module(NULL, d->slot, "8041");
 	return &i_8041_out_ops;
 }
 
@@ -119,6 +144,7 @@ static struct block_builder i_8041_out_builder = {
 	.ops		= i_8041_out_init,
 	.setpoints	= out_setpoints,
 	.inputs		= out_inputs,
+	.flags		= PCS_BLOCK_IO,
 };
 
 struct block_builder *
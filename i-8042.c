@@ -23,6 +23,7 @@
 #include "i-8042.h"
 #include "icpdas.h"
 #include "map.h"
+#include "shadow.h"
 #include "state.h"
 
 #define PCS_BLOCK	"i-8042"
@@ -127,6 +128,9 @@ static struct block_ops i_8042_ops = {
 static struct block_ops *
 i_8042_init(struct block *b)
 {
+	struct i_8042_state *d = b->data;
+
+	icpdas_expect_module(NULL, d->slot, "8042");
 	return &i_8042_ops;
 }
 
@@ -135,6 +139,7 @@ static struct block_builder i_8042_builder = {
 	.ops		= i_8042_init,
 	.setpoints	= setpoints,
 	.outputs	= outputs,
+	.flags		= PCS_BLOCK_IO | PCS_BLOCK_INPUT,
 };
 
 struct block_builder *
@@ -148,6 +153,7 @@ struct i_8042_out_state {
 	unsigned		slot;
 	long			*status;
 	long			*DO[16];
+	struct shadow		shadow;
 };
 
 static void
@@ -165,9 +171,13 @@ i_8042_out_run(struct block *b, struct server_state *s)
 		if (i > 0)
 			do16 <<= 1;
 	}
-	err = icpdas_set_parallel_output(d->slot, do16);
-	if (0 > err)
+	if (!shadow_update(&d->shadow, do16))
+		return;
+	err = icpdas_stage_parallel_output(d->slot, do16, 0xffff, &d->shadow);
+	if (0 > err) {
 		error("%s: i-8042 output error %i\n", b->name, err);
+		shadow_invalidate(&d->shadow);
+	}
 
 	debug3("%s: i-8042 do 0x%04lx\n",
 			b->name, do16);
@@ -182,6 +192,18 @@ set_out_slot(void *data, const char const *key, long value)
 	return 0;
 }
 
+static int
+set_refresh(void *data, const char const *key, long value)
+{
+	struct i_8042_out_state *d = data;
+
+	if (value < 0)
+		return 1;
+	shadow_init(&d->shadow, value);
+	debug("refresh = %li\n", value);
+	return 0;
+}
+
 static void
 set_out_status(void *data, const char const *key, long *input)
 {
@@ -202,6 +224,10 @@ set_input(void *data, const char const *key, long *input)
 
 static struct pcs_map out_setpoints[] = {
 	{
+		.key			= "refresh",
+		.value			= set_refresh,
+	}
+	,{
 		.key			= "slot",
 		.value			= set_out_slot,
 	}
@@ -223,7 +249,10 @@ static struct pcs_map out_inputs[] = {
 static void *
 i_8042_out_alloc(void)
 {
-	return xzalloc(sizeof(struct i_8042_out_state));
+	struct i_8042_out_state *d = xzalloc(sizeof(struct i_8042_out_state));
+
+	shadow_init(&d->shadow, PCS_SHADOW_REFRESH);
+	return d;
 }
 
 static struct block_ops i_8042_out_ops = {
@@ -236,6 +265,7 @@ i_8042_out_init(struct block *b)
 	struct i_8042_out_state *d = b->data;
 	if (!d->status)
 		fatal("'i-8042 out' needs status input\n");
+	icpdas_expect_module(NULL, d->slot, "8042");
 	return &i_8042_out_ops;
 }
 
@@ -244,6 +274,7 @@ static struct block_builder i_8042_out_builder = {
 	.ops		= i_8042_out_init,
 	.setpoints	= out_setpoints,
 	.inputs		= out_inputs,
+	.flags		= PCS_BLOCK_IO,
 };
 
 struct block_builder *
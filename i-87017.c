@@ -20,6 +20,7 @@
 #include "includes.h"
 
 #include <stdio.h>
+#include <string.h>
 
 #include "block.h"
 #include "i-87017.h"
@@ -34,19 +35,23 @@ static const char const *default_device = "/dev/ttyS1";
 struct i_87017_state {
 	unsigned		slot;
 	const char		*device;
+	struct icpdas_request	req;
 };
 
 static void
-i_87017_run(struct block *b, struct server_state *s)
+i_87017_done(struct icpdas_request *r, int err, const char *reply)
 {
 	char buff[128];
+	struct block *b = r->data;
 	struct i_87017_state *d = b->data;
 	long *ai = b->outputs;
-	int err;
 	size_t pos = 0;
 	int i;
 
-	err = icpdas_get_serial_analog_input(d->device, d->slot, 8, ai);
+	if (0 <= err && r->reply_size > 1 + 8 * 7)
+		err = icpdas_parse_sync_analog_input(reply, 8, ai);
+	else if (0 <= err)
+		err = icpdas_parse_analog_input(reply, 8, ai);
 	if (0 > err)
 		error("bad i-87017 input, slot %u\n", d->slot);
 
@@ -56,6 +61,24 @@ i_87017_run(struct block *b, struct server_state *s)
 	debug("%s\n", buff);
 }
 
+static void
+i_87017_run(struct block *b, struct server_state *s)
+{
+	struct i_87017_state *d = b->data;
+
+	d->req.slot = d->slot;
+	if (icpdas_serial_sync_enabled()) {
+		d->req.cmd = "$004";
+		d->req.reply_size = 4 + 8 * 7;
+	} else {
+		d->req.cmd = "#00";
+		d->req.reply_size = 1 + 8 * 7;
+	}
+	d->req.done = i_87017_done;
+	d->req.data = b;
+	icpdas_serial_submit(d->device, &d->req);
+}
+
 static int
 set_slot(void *data, const char const *key, long value)
 {
@@ -74,6 +97,24 @@ static struct pcs_map setpoints[] = {
 	}
 };
 
+static int
+set_device(void *data, const char const *key, const char const *value)
+{
+	struct i_87017_state *d = data;
+	d->device = strdup(value);
+	debug("device = %s\n", d->device);
+	return 0;
+}
+
+static struct pcs_map strings[] = {
+	{
+		.key			= "device",
+		.value			= set_device,
+	}
+	,{
+	}
+};
+
 static const char *outputs[] = {
 	"ai0",
 	"ai1",
@@ -94,13 +135,26 @@ alloc(void)
 	return d;
 }
 
+static void
+i_87017_prepare(struct block *b, struct server_state *s)
+{
+	struct i_87017_state *d = b->data;
+
+	icpdas_serial_sync_slot(d->device, d->slot);
+}
+
 static struct block_ops ops = {
+	.prepare	= i_87017_prepare,
 	.run		= i_87017_run,
 };
 
 static struct block_ops *
 init(struct block *b)
 {
+	struct i_87017_state *d = b->data;
+
+	icpdas_serial_attach(d->device, d->slot, 1);
+	icpdas_expect_module(d->device, d->slot, "87017");
 	return &ops;
 }
 
@@ -108,7 +162,10 @@ static struct block_builder builder = {
 	.alloc		= alloc,
 	.ops		= init,
 	.setpoints	= setpoints,
+	.strings	= strings,
 	.outputs	= outputs,
+	.flags		= PCS_BLOCK_IO | PCS_BLOCK_INPUT |
+			  PCS_BLOCK_SERIAL,
 };
 
 struct block_builder *
@@ -19,6 +19,8 @@
 
 #include "includes.h"
 
+#include <string.h>
+
 #include "block.h"
 #include "i-87040.h"
 #include "icpdas.h"
@@ -32,18 +34,23 @@ static const char const *default_device = "/dev/ttyS1";
 struct i_87040_state {
 	unsigned		slot;
 	const char		*device;
+	struct icpdas_request	req;
 };
 
 static void
-i_87040_run(struct block *b, struct server_state *s)
+i_87040_done(struct icpdas_request *r, int err, const char *reply)
 {
+	struct block *b = r->data;
 	struct i_87040_state *d = b->data;
 	unsigned long di32;
-	int err, i;
+	int i;
 
-	err = icpdas_get_serial_digital_input(d->device, d->slot, &di32);
-	if (0 > err)
+	if (0 <= err)
+		err = icpdas_parse_digital_input(reply, &di32);
+	if (0 > err) {
 		error("bad i-87040 input in slot %u\n", d->slot);
+		return;
+	}
 
 	debug3("%s: i-87040 di 0x%08lx\n",
 			b->name, di32);
@@ -54,6 +61,19 @@ i_87040_run(struct block *b, struct server_state *s)
 	}
 }
 
+static void
+i_87040_run(struct block *b, struct server_state *s)
+{
+	struct i_87040_state *d = b->data;
+
+	d->req.slot = d->slot;
+	d->req.cmd = "@00";
+	d->req.reply_size = 1 + 8;
+	d->req.done = i_87040_done;
+	d->req.data = b;
+	icpdas_serial_submit(d->device, &d->req);
+}
+
 static int
 set_slot(void *data, const char const *key, long value)
 {
@@ -72,6 +92,24 @@ static struct pcs_map setpoints[] = {
 	}
 };
 
+static int
+set_device(void *data, const char const *key, const char const *value)
+{
+	struct i_87040_state *d = data;
+	d->device = strdup(value);
+	debug("device = %s\n", d->device);
+	return 0;
+}
+
+static struct pcs_map strings[] = {
+	{
+		.key			= "device",
+		.value			= set_device,
+	}
+	,{
+	}
+};
+
 static const char *outputs[] = {
 	"di0",
 	"di1",
@@ -123,6 +161,10 @@ static struct block_ops i_87040_ops = {
 static struct block_ops *
 i_87040_init(struct block *b)
 {
+	struct i_87040_state *d = b->data;
+
+	icpdas_serial_attach(d->device, d->slot, 0);
+	icpdas_expect_module(d->device, d->slot, "87040");
 	return &i_87040_ops;
 }
 
@@ -130,7 +172,10 @@ static struct block_builder i_87040_builder = {
 	.alloc		= i_87040_alloc,
 	.ops		= i_87040_init,
 	.setpoints	= setpoints,
+	.strings	= strings,
 	.outputs	= outputs,
+	.flags		= PCS_BLOCK_IO | PCS_BLOCK_INPUT |
+			  PCS_BLOCK_SERIAL,
 };
 
 struct block_builder *
@@ -0,0 +1,127 @@
+/* icpdas-backend.h -- hardware access behind the ICP DAS interface
+ * Copyright (C) 2014 Sergey Yanovich <ynvich@gmail.com>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 2 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public
+ * License along with this program; if not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+ * Boston, MA 02111-1307, USA.
+ */
+
+#ifndef _PCS_ICPDAS_BACKEND_H
+#define _PCS_ICPDAS_BACKEND_H
+
+#include <pthread.h>
+#include <time.h>
+
+#define ICP_RX_SIZE	512
+#define ICP_SAMPLES	64
+/* Returned by a transfer which got no reply before the deadline */
+#define ICP_TIMEOUT	-2
+
+enum icpdas_attr {
+	ICP_INPUT_STATUS,
+	ICP_OUTPUT_STATUS,
+	ICP_ANALOG_OUTPUT,
+	ICP_RESET,
+	ICP_ATTR_COUNT
+};
+
+extern const char *const icpdas_attr_names[ICP_ATTR_COUNT];
+
+/*
+ * Turnaround is the reply time less the time the characters take on the
+ * wire. Every ICP_SAMPLES_UPDATE replies the median and p99 are taken
+ * over the last ICP_SAMPLES, and the slot allowance becomes twice the
+ * p99. A timeout doubles the allowance, so a module which slowed down
+ * gets a chance to reply again.
+ */
+struct icpdas_slot_stats {
+	unsigned long		count;
+	unsigned long		timeouts;
+	long			samples[ICP_SAMPLES];
+	long			p50;
+	long			p99;
+	long			turnaround;
+};
+
+/*
+ * A serial bus keeps its port open and configured between exchanges.
+ * The port is reopened after an I/O error. A timeout marks the bus
+ * stale, and the next exchange drops any late reply before sending.
+ *
+ * Replies are read in bulk into rx. Bytes past the CR that ends a reply
+ * stay there for the next exchange.
+ *
+ * port serializes exchanges. lock guards the request queue, which a
+ * worker thread of the bus drains in batch mode. stats_lock guards the
+ * slot stats, which are saved from the tick thread.
+ */
+struct icpdas_bus {
+	struct icpdas_bus	*next;
+	char			*device;
+	int			fd;
+	pthread_mutex_t		port;
+	pthread_mutex_t		lock;
+	pthread_cond_t		cond;
+	pthread_t		tid;
+	int			worker;
+	int			quit;
+	int			busy;
+	int			stale;
+	struct icpdas_request	*queue;
+	unsigned int		sync_slots;
+	unsigned int		sync_due;
+	struct icpdas_request	trigger[9];
+	pthread_mutex_t		stats_lock;
+	struct icpdas_slot_stats	stats[9];
+	int			rx_len;
+	char			rx[ICP_RX_SIZE];
+};
+
+/*
+ * Parallel slots are accessed one attribute at a time, as text in the
+ * format of the backplane sysfs files. A serial exchange selects the
+ * slot, then transfers tx, which ends with CR, and reads the reply into
+ * data before the deadline. expect is as in icpdas_bus_exchange().
+ * Optional operations are NULL.
+ */
+struct icpdas_backend {
+	const char		*name;
+	int			(*open)(const char *file);
+	int			(*module_count)(void);
+	int			(*module_name)(unsigned int slot, int size,
+					char *data);
+	int			(*read)(unsigned int slot,
+					enum icpdas_attr attr, int size,
+					char *data);
+	int			(*write)(unsigned int slot,
+					enum icpdas_attr attr,
+					const char *data, int size);
+	int			(*select)(struct icpdas_bus *bus,
+					unsigned int slot);
+	int			(*transfer)(struct icpdas_bus *bus,
+					unsigned int slot, const char *tx,
+					int len, int expect,
+					const struct timespec *deadline,
+					int size, char *data);
+};
+
+extern const struct icpdas_backend icpdas_sysfs_backend;
+extern const struct icpdas_backend icpdas_sim_backend;
+extern const struct icpdas_backend icpdas_replay_backend;
+
+long
+icpdas_wire_usec(int chars);
+int
+icpdas_backend_wait(long usec, const struct timespec *deadline);
+#endif /* _PCS_ICPDAS_BACKEND_H */
@@ -0,0 +1,227 @@
+/* icpdas-replay.c -- replay captured ICP DAS traffic
+ * Copyright (C) 2014 Sergey Yanovich <ynvich@gmail.com>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 2 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public
+ * License along with this program; if not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+ * Boston, MA 02111-1307, USA.
+ */
+
+#include "includes.h"
+
+#include <errno.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "icpdas.h"
+#include "icpdas-backend.h"
+
+/*
+ * The replay backend reads a capture file at startup. Every parallel
+ * attribute and every serial command gets the values captured for it,
+ * in the captured order, starting over after the last one. A serial
+ * reply comes after the captured time, but no later than the deadline,
+ * since a loaded machine may have captured it late. A captured timeout
+ * times out again. Writes and commands without a reply are accepted and
+ * dropped.
+ */
+struct icpdas_replay_entry {
+	char			*key;
+	unsigned int		line;
+	long			usec;
+	char			*data;
+};
+
+struct icpdas_replay_group {
+	const char		*key;
+	unsigned int		first;
+	unsigned int		count;
+	unsigned int		cursor;
+};
+
+static struct icpdas_replay_entry *icpdas_replay_entries;
+static struct icpdas_replay_group *icpdas_replay_groups;
+static unsigned int icpdas_replay_group_count;
+static pthread_mutex_t icpdas_replay_lock = PTHREAD_MUTEX_INITIALIZER;
+
+static int
+icpdas_replay_cmp_entry(const void *a, const void *b)
+{
+	const struct icpdas_replay_entry *x = a, *y = b;
+	int d = strcmp(x->key, y->key);
+
+	if (d)
+		return d;
+	return x->line < y->line ? -1 : x->line > y->line;
+}
+
+static int
+icpdas_replay_cmp_group(const void *key, const void *g)
+{
+	return strcmp(key, ((const struct icpdas_replay_group *) g)->key);
+}
+
+/* Returns the next entry for key, or NULL if nothing was captured */
+static struct icpdas_replay_entry *
+icpdas_replay_next(const char *key)
+{
+	struct icpdas_replay_group *g;
+	struct icpdas_replay_entry *e;
+
+	g = bsearch(key, icpdas_replay_groups, icpdas_replay_group_count,
+			sizeof(*g), icpdas_replay_cmp_group);
+	if (!g)
+		return NULL;
+	pthread_mutex_lock(&icpdas_replay_lock);
+	e = &icpdas_replay_entries[g->first + g->cursor];
+	g->cursor = (g->cursor + 1) % g->count;
+	pthread_mutex_unlock(&icpdas_replay_lock);
+	return e;
+}
+
+static int
+icpdas_replay_parse(char *line, struct icpdas_replay_entry *e)
+{
+	char key[320], data[ICP_RX_SIZE], device[128], cmd[128];
+	unsigned int slot;
+
+	if (3 == sscanf(line, "parallel %u %127s %511s", &slot, cmd, data))
+		snprintf(key, sizeof(key), "parallel %u %s", slot, cmd);
+	else if (5 == sscanf(line, "serial %127s %u %li %127s %511s", device,
+				&slot, &e->usec, cmd, data))
+		snprintf(key, sizeof(key), "serial %s %u %s", device, slot,
+				cmd);
+	else
+		return -1;
+
+	e->key = strdup(key);
+	e->data = strcmp(data, "-") ? strdup(data) : NULL;
+	return 0;
+}
+
+static int
+icpdas_replay_open(const char *file)
+{
+	struct icpdas_replay_entry *e;
+	struct icpdas_replay_group *g;
+	unsigned int count = 0, size = 0, i;
+	char line[1024];
+	FILE *f;
+
+	if (!file) {
+		error("replay I/O needs a capture file\n");
+		return -1;
+	}
+	f = fopen(file, "r");
+	if (!f) {
+		error("%s: %s (%i)\n", file, strerror(errno), errno);
+		return -1;
+	}
+	while (fgets(line, sizeof(line), f)) {
+		if (count == size) {
+			size = size ? size * 2 : 256;
+			icpdas_replay_entries = xrealloc(icpdas_replay_entries,
+					size, sizeof(*e));
+		}
+		e = &icpdas_replay_entries[count];
+		e->line = count + 1;
+		if (icpdas_replay_parse(line, e)) {
+			error("%s: bad capture at line %u\n", file, e->line);
+			fclose(f);
+			return -1;
+		}
+		count++;
+	}
+	fclose(f);
+
+	qsort(icpdas_replay_entries, count, sizeof(*e),
+			icpdas_replay_cmp_entry);
+	icpdas_replay_groups = xcalloc(count ? count : 1, sizeof(*g));
+	for (i = 0; i < count; i++) {
+		e = &icpdas_replay_entries[i];
+		g = &icpdas_replay_groups[icpdas_replay_group_count];
+		if (i && !strcmp(e->key, g[-1].key)) {
+			g[-1].count++;
+			continue;
+		}
+		g->key = e->key;
+		g->first = i;
+		g->count = 1;
+		icpdas_replay_group_count++;
+	}
+	debug("%s: %u values for %u keys\n", file, count,
+			icpdas_replay_group_count);
+	return 0;
+}
+
+static int
+icpdas_replay_read(unsigned int slot, enum icpdas_attr attr, int size,
+		char *data)
+{
+	struct icpdas_replay_entry *e;
+	char key[320];
+
+	snprintf(key, sizeof(key), "parallel %u %s", slot,
+			icpdas_attr_names[attr]);
+	e = icpdas_replay_next(key);
+	if (!e || !e->data) {
+		error("slot%02u/%s: nothing to replay\n", slot,
+				icpdas_attr_names[attr]);
+		return -1;
+	}
+	return snprintf(data, size, "%s", e->data);
+}
+
+static int
+icpdas_replay_write(unsigned int slot, enum icpdas_attr attr,
+		const char *data, int size)
+{
+	return 0;
+}
+
+static int
+icpdas_replay_transfer(struct icpdas_bus *bus, unsigned int slot,
+		const char *tx, int len, int expect,
+		const struct timespec *deadline, int size, char *data)
+{
+	struct icpdas_replay_entry *e;
+	char key[320];
+
+	if (0 > expect)
+		return 0;
+	snprintf(key, sizeof(key), "serial %s %u %.*s", bus->device, slot,
+			len - 1, tx);
+	e = icpdas_replay_next(key);
+	if (!e) {
+		error("%s: nothing to replay for %s\n", bus->device, &key[7]);
+		return -1;
+	}
+	icpdas_backend_wait(e->usec, deadline);
+	if (!e->data)
+		return ICP_TIMEOUT;
+	if (strlen(e->data) >= size) {
+		error("%s: reply is too long (%zu)\n", bus->device,
+				strlen(e->data));
+		return -1;
+	}
+	return snprintf(data, size, "%s", e->data);
+}
+
+const struct icpdas_backend icpdas_replay_backend = {
+	.name		= "replay",
+	.open		= icpdas_replay_open,
+	.read		= icpdas_replay_read,
+	.write		= icpdas_replay_write,
+	.transfer	= icpdas_replay_transfer,
+};
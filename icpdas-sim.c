@@ -0,0 +1,466 @@
+/* icpdas-sim.c -- simulated ICP DAS backplane
+ * Copyright (C) 2014 Sergey Yanovich <ynvich@gmail.com>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 2 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public
+ * License along with this program; if not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+ * Boston, MA 02111-1307, USA.
+ */
+
+#define _GNU_SOURCE
+#include "includes.h"
+
+#include <math.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "icpdas.h"
+#include "icpdas-backend.h"
+#include "pcs-clock.h"
+
+/*
+ * The simulator answers for the modules listed in the configuration.
+ * Parallel modules keep their outputs and report fixed inputs. Serial
+ * modules answer the DCON commands the blocks use, after the time the
+ * characters take on the wire plus the module latency and a random
+ * jitter. A module which is missing or takes longer than the deadline
+ * times out, as it would on the bus.
+ */
+static const struct icpdas_sim_model {
+	const char		*name;
+	int			parallel;
+	int			channels;
+	int			decimals;
+	int			digital;
+} icpdas_sim_models[] = {
+	{ "i-8024",	1,	0,	0,	0 },
+	{ "i-8041",	1,	0,	0,	0 },
+	{ "i-8042",	1,	0,	0,	0 },
+	{ "i-87015",	0,	7,	2,	0 },
+	{ "i-87017",	0,	8,	3,	0 },
+	{ "i-87040",	0,	0,	0,	1 },
+	{ NULL }
+};
+
+enum icpdas_sim_kind {
+	ICP_SIM_CONST,
+	ICP_SIM_SINE,
+	ICP_SIM_RAMP,
+	ICP_SIM_SQUARE,
+	ICP_SIM_NOISE,
+	ICP_SIM_KINDS
+};
+
+static const struct {
+	const char		*name;
+	int			args;
+} icpdas_sim_kinds[ICP_SIM_KINDS] = {
+	[ICP_SIM_CONST]		= { "const",	1 },
+	[ICP_SIM_SINE]		= { "sine",	3 },
+	[ICP_SIM_RAMP]		= { "ramp",	3 },
+	[ICP_SIM_SQUARE]	= { "square",	3 },
+	[ICP_SIM_NOISE]		= { "noise",	2 },
+};
+
+struct icpdas_sim_signal {
+	enum icpdas_sim_kind	kind;
+	long			a;
+	long			b;
+	long			period;
+};
+
+struct icpdas_sim_module {
+	const struct icpdas_sim_model	*model;
+	long			latency;
+	long			jitter;
+	unsigned int		seed;
+	unsigned long		inputs;
+	unsigned long		outputs;
+	long			analog[4];
+	unsigned long		writes;
+	struct icpdas_sim_signal	signal[8];
+	struct timespec		latched;
+	int			fresh;
+};
+
+static struct icpdas_sim_module icpdas_sim_modules[9];
+static struct timespec icpdas_sim_epoch;
+static pthread_mutex_t icpdas_sim_lock = PTHREAD_MUTEX_INITIALIZER;
+
+static struct icpdas_sim_module *
+icpdas_sim_module(unsigned int slot)
+{
+	if (slot == 0 || slot > 8) {
+		error("%s: bad slot (%u)\n", __FUNCTION__, slot);
+		return NULL;
+	}
+	return &icpdas_sim_modules[slot];
+}
+
+int
+icpdas_sim_set_model(unsigned int slot, const char *model)
+{
+	struct icpdas_sim_module *m = icpdas_sim_module(slot);
+	const struct icpdas_sim_model *p;
+
+	if (!m)
+		return -1;
+	for (p = icpdas_sim_models; p->name; p++)
+		if (!strcmp(p->name, model))
+			break;
+	if (!p->name) {
+		error("%s: unknown model %s\n", __FUNCTION__, model);
+		return -1;
+	}
+	m->model = p;
+	m->seed = slot;
+	return 0;
+}
+
+int
+icpdas_sim_set_latency(unsigned int slot, long usec)
+{
+	struct icpdas_sim_module *m = icpdas_sim_module(slot);
+
+	if (!m || 0 > usec)
+		return -1;
+	m->latency = usec;
+	return 0;
+}
+
+/* Returns the number of writes to a parallel module so far */
+unsigned long
+icpdas_sim_writes(unsigned int slot)
+{
+	struct icpdas_sim_module *m = icpdas_sim_module(slot);
+	unsigned long writes;
+
+	if (!m)
+		return 0;
+	pthread_mutex_lock(&icpdas_sim_lock);
+	writes = m->writes;
+	pthread_mutex_unlock(&icpdas_sim_lock);
+	return writes;
+}
+
+int
+icpdas_sim_set_jitter(unsigned int slot, long usec)
+{
+	struct icpdas_sim_module *m = icpdas_sim_module(slot);
+
+	if (!m || 0 > usec)
+		return -1;
+	m->jitter = usec;
+	return 0;
+}
+
+int
+icpdas_sim_set_inputs(unsigned int slot, unsigned long inputs)
+{
+	struct icpdas_sim_module *m = icpdas_sim_module(slot);
+
+	if (!m)
+		return -1;
+	m->inputs = inputs;
+	return 0;
+}
+
+/*
+ * A signal is a number, or a generator with its arguments, periods in
+ * milliseconds:
+ *
+ *   const <value>
+ *   sine <offset> <amplitude> <period>
+ *   ramp <from> <to> <period>
+ *   square <low> <high> <period>
+ *   noise <offset> <amplitude>
+ */
+int
+icpdas_sim_set_signal(unsigned int slot, unsigned int channel,
+		const char *spec)
+{
+	struct icpdas_sim_module *m = icpdas_sim_module(slot);
+	struct icpdas_sim_signal sg = { 0 };
+	char kind[16], *end;
+	long args[3];
+	int n, i;
+
+	if (!m)
+		return -1;
+	if (channel >= 8) {
+		error("%s: bad channel (%u)\n", __FUNCTION__, channel);
+		return -1;
+	}
+
+	sg.a = strtol(spec, &end, 0);
+	if (end != spec && !*end) {
+		m->signal[channel] = sg;
+		return 0;
+	}
+
+	n = sscanf(spec, "%15s %li %li %li", kind, &args[0], &args[1],
+			&args[2]);
+	for (i = 0; i < ICP_SIM_KINDS; i++)
+		if (n > 0 && !strcmp(kind, icpdas_sim_kinds[i].name))
+			break;
+	if (i == ICP_SIM_KINDS ||
+			n - 1 != icpdas_sim_kinds[i].args) {
+		error("%s: bad signal '%s'\n", __FUNCTION__, spec);
+		return -1;
+	}
+	sg.kind = i;
+	sg.a = args[0];
+	if (n > 2)
+		sg.b = args[1];
+	if (n > 3)
+		sg.period = args[2];
+	if ((n > 3 && 0 >= sg.period) || (ICP_SIM_NOISE == i && 0 > sg.b)) {
+		error("%s: bad signal '%s'\n", __FUNCTION__, spec);
+		return -1;
+	}
+	m->signal[channel] = sg;
+	return 0;
+}
+
+static long
+icpdas_sim_value(struct icpdas_sim_signal *sg, long ms, unsigned int *seed)
+{
+	long t = sg->period ? ms % sg->period : 0;
+
+	switch (sg->kind) {
+	case ICP_SIM_SINE:
+		return sg->a + lround(sg->b * sin(2 * M_PI * t / sg->period));
+	case ICP_SIM_RAMP:
+		return sg->a + (sg->b - sg->a) * t / sg->period;
+	case ICP_SIM_SQUARE:
+		return t < sg->period / 2 ? sg->a : sg->b;
+	case ICP_SIM_NOISE:
+		return sg->a - sg->b + rand_r(seed) % (2 * sg->b + 1);
+	default:
+		return sg->a;
+	}
+}
+
+/* Formats the channels as the module does, +dd.ddd for I-87017 */
+static int
+icpdas_sim_analog(struct icpdas_sim_module *m, const struct timespec *at,
+		char *buff, int size)
+{
+	long ms = pcs_clock_diff(at, &icpdas_sim_epoch) / 1000;
+	int decimals = m->model->decimals, len = 0, i;
+	long scale = 1, v;
+
+	for (i = 0; i < decimals; i++)
+		scale *= 10;
+	for (i = 0; i < m->model->channels && len < size; i++) {
+		v = icpdas_sim_value(&m->signal[i], ms, &m->seed);
+		if (v > 99999)
+			v = 99999;
+		else if (v < -99999)
+			v = -99999;
+		len += snprintf(&buff[len], size - len, "%c%0*li.%0*li",
+				0 > v ? '-' : '+', 5 - decimals,
+				labs(v) / scale, decimals, labs(v) % scale);
+	}
+	return len;
+}
+
+/*
+ * Puts the module reply to cmd into buff, and the time the module takes
+ * to answer into latency. Returns the reply length, or -1 if nobody
+ * answers.
+ */
+static int
+icpdas_sim_reply(unsigned int slot, const char *cmd, char *buff, int size,
+		long *latency)
+{
+	struct icpdas_sim_module *m = &icpdas_sim_modules[slot];
+	struct timespec now;
+
+	if (!m->model || m->model->parallel)
+		return -1;
+
+	*latency = m->latency;
+	if (m->jitter)
+		*latency += rand_r(&m->seed) % m->jitter;
+	pcs_clock_now(&now);
+
+	if (!strcmp(cmd, "$00M"))
+		return snprintf(buff, size, "!00%s", &m->model->name[2]);
+	if (!strcmp(cmd, "#**")) {
+		m->latched = now;
+		m->fresh = 1;
+		return 0;
+	}
+	if (m->model->channels && !strcmp(cmd, "#00")) {
+		buff[0] = '>';
+		return 1 + icpdas_sim_analog(m, &now, &buff[1], size - 1);
+	}
+	if (m->model->channels && !strcmp(cmd, "$004")) {
+		snprintf(buff, size, ">00%c", m->fresh ? '1' : '0');
+		if (!m->fresh)
+			m->latched = now;
+		m->fresh = 0;
+		return 4 + icpdas_sim_analog(m, &m->latched, &buff[4],
+				size - 4);
+	}
+	if (m->model->digital && !strcmp(cmd, "@00"))
+		return snprintf(buff, size, ">%08lx", m->inputs);
+	return snprintf(buff, size, "?00");
+}
+
+int
+icpdas_sim_answer(unsigned int slot, const char *cmd, char *reply, int size,
+		long *latency)
+{
+	int n;
+
+	if (slot > 8)
+		return -1;
+	pthread_mutex_lock(&icpdas_sim_lock);
+	n = icpdas_sim_reply(slot, cmd, reply, size, latency);
+	pthread_mutex_unlock(&icpdas_sim_lock);
+	return n;
+}
+
+static int
+icpdas_sim_transfer(struct icpdas_bus *bus, unsigned int slot,
+		const char *tx, int len, int expect,
+		const struct timespec *deadline, int size, char *data)
+{
+	char cmd[ICP_RX_SIZE], reply[ICP_RX_SIZE];
+	long latency = 0;
+	int n;
+
+	snprintf(cmd, sizeof(cmd), "%.*s", len - 1, tx);
+	n = icpdas_sim_answer(slot, cmd, reply, sizeof(reply), &latency);
+
+	if (0 > expect) {
+		icpdas_backend_wait(icpdas_wire_usec(len), deadline);
+		return 0;
+	}
+	if (0 > n) {
+		icpdas_backend_wait(1000000000L, deadline);
+		return ICP_TIMEOUT;
+	}
+	if (icpdas_backend_wait(icpdas_wire_usec(len + n + 1) + latency,
+				deadline))
+		return ICP_TIMEOUT;
+	if (n >= size) {
+		error("%s: reply is too long (%i)\n", bus->device, n);
+		return -1;
+	}
+	memcpy(data, reply, n + 1);
+	return n;
+}
+
+static struct icpdas_sim_module *
+icpdas_sim_parallel(unsigned int slot, enum icpdas_attr attr)
+{
+	struct icpdas_sim_module *m = &icpdas_sim_modules[slot];
+
+	if (m->model && m->model->parallel)
+		return m;
+	error("slot%02u/%s: no simulated module\n", slot,
+			icpdas_attr_names[attr]);
+	return NULL;
+}
+
+static int
+icpdas_sim_read(unsigned int slot, enum icpdas_attr attr, int size,
+		char *data)
+{
+	struct icpdas_sim_module *m = icpdas_sim_parallel(slot, attr);
+	int err = -1;
+
+	if (!m)
+		return -1;
+	pthread_mutex_lock(&icpdas_sim_lock);
+	if (ICP_INPUT_STATUS == attr)
+		err = snprintf(data, size, "0x%08lx\n", m->inputs);
+	else if (ICP_OUTPUT_STATUS == attr)
+		err = snprintf(data, size, "0x%08lx\n", m->outputs);
+	pthread_mutex_unlock(&icpdas_sim_lock);
+	if (0 > err)
+		error("slot%02u/%s: not readable\n", slot,
+				icpdas_attr_names[attr]);
+	return err;
+}
+
+static int
+icpdas_sim_write(unsigned int slot, enum icpdas_attr attr,
+		const char *data, int size)
+{
+	struct icpdas_sim_module *m = icpdas_sim_parallel(slot, attr);
+	char buff[32];
+	unsigned long v;
+
+	if (!m)
+		return -1;
+	snprintf(buff, sizeof(buff), "%.*s", size, data);
+	v = strtoul(buff, NULL, 16);
+	pthread_mutex_lock(&icpdas_sim_lock);
+	m->writes++;
+	if (ICP_OUTPUT_STATUS == attr)
+		m->outputs = v;
+	else if (ICP_ANALOG_OUTPUT == attr)
+		m->analog[(v >> 14) & 3] = (long) (v & 0x3fff) - 0x2000;
+	else if (ICP_RESET == attr)
+		memset(m->analog, 0, sizeof(m->analog));
+	pthread_mutex_unlock(&icpdas_sim_lock);
+	return 0;
+}
+
+static int
+icpdas_sim_module_count(void)
+{
+	int slot;
+
+	for (slot = 8; slot > 0; slot--)
+		if (icpdas_sim_modules[slot].model)
+			break;
+	return slot;
+}
+
+static int
+icpdas_sim_module_name(unsigned int slot, int size, char *data)
+{
+	struct icpdas_sim_module *m = &icpdas_sim_modules[slot];
+
+	if (slot == 0 || slot > 8 || !m->model || !m->model->parallel)
+		return -1;
+	snprintf(data, size, "%s", &m->model->name[2]);
+	return 0;
+}
+
+static int
+icpdas_sim_open(const char *file)
+{
+	if (file) {
+		error("simulated I/O does not use a file\n");
+		return -1;
+	}
+	pcs_clock_now(&icpdas_sim_epoch);
+	return 0;
+}
+
+const struct icpdas_backend icpdas_sim_backend = {
+	.name		= "simulator",
+	.open		= icpdas_sim_open,
+	.module_count	= icpdas_sim_module_count,
+	.module_name	= icpdas_sim_module_name,
+	.read		= icpdas_sim_read,
+	.write		= icpdas_sim_write,
+	.transfer	= icpdas_sim_transfer,
+};
@@ -17,44 +17,118 @@
  * Boston, MA 02111-1307, USA.
  */
 
+#define _GNU_SOURCE
 #include "includes.h"
 
 #include <errno.h>
 #include <fcntl.h>
+#include <poll.h>
+#include <pthread.h>
+#include <signal.h>
 #include <stdio.h>
 #include <string.h>
 #include <termios.h>
 #include <unistd.h>
 
 #include "icpdas.h"
+#include "icpdas-backend.h"
+#include "pcs-clock.h"
+#include "shadow.h"
 
-#define ICP_SLOT_COUNT_FILE  "/sys/bus/icpdas/devices/backplane/slot_count"
-#define ICP_ACTIVE_SLOT_FILE "/sys/bus/icpdas/devices/backplane/active_slot"
+#define ICP_SYSFS_ROOT		"/sys/bus/icpdas/devices"
+#define ICP_SLOT_COUNT_FILE	"%s/backplane/slot_count"
+#define ICP_ACTIVE_SLOT_FILE	"%s/backplane/active_slot"
+
+static const struct icpdas_backend *icpdas_backend = &icpdas_sysfs_backend;
+
+static const struct icpdas_backend *icpdas_backends[] = {
+	&icpdas_sysfs_backend,
+	&icpdas_sim_backend,
+	&icpdas_replay_backend,
+	NULL
+};
+
+/*
+ * A capture file gets every value read from the hardware, in the
+ * format which the replay backend reads back:
+ *
+ *   parallel <slot> <attribute> <data>
+ *   serial <device> <slot> <usec> <command> <reply>
+ *
+ * usec is the time the exchange took, and the reply is '-' after a
+ * timeout. Commands without a reply are left out.
+ */
+static FILE *icpdas_capture;
+
+int
+icpdas_io_setup(const char *backend, const char *file, const char *capture)
+{
+	const struct icpdas_backend **b;
+
+	if (backend) {
+		for (b = icpdas_backends; *b; b++)
+			if (!strcmp((*b)->name, backend))
+				break;
+		if (!*b) {
+			error("unknown I/O backend %s\n", backend);
+			return -1;
+		}
+		icpdas_backend = *b;
+	}
+	if (icpdas_backend->open && 0 > icpdas_backend->open(file))
+		return -1;
+	if (!icpdas_backend->open && file) {
+		error("%s I/O does not use a file\n", icpdas_backend->name);
+		return -1;
+	}
+	if (!capture)
+		return 0;
+	icpdas_capture = fopen(capture, "w");
+	if (!icpdas_capture) {
+		error("%s: %s (%i)\n", capture, strerror(errno), errno);
+		return -1;
+	}
+	return 0;
+}
+
+/*
+ * The backplane driver files live under the sysfs root, which may be
+ * moved elsewhere to run against an emulated backplane.
+ */
+static const char *icpdas_sysfs_root = ICP_SYSFS_ROOT;
+
+void
+icpdas_sysfs_set_root(const char *root)
+{
+	icpdas_sysfs_root = root ? root : ICP_SYSFS_ROOT;
+}
 
 static int
-icpdas_module_count(void)
+icpdas_sysfs_module_count(void)
 {
 	int fd;
-	char buff[256];
+	char path[256], buff[256];
 	size_t sz;
 
-	fd = open(ICP_SLOT_COUNT_FILE, O_RDONLY);
+	snprintf(path, sizeof(path), ICP_SLOT_COUNT_FILE, icpdas_sysfs_root);
+	fd = open(path, O_RDONLY);
 	if (-1 == fd) {
-		error("%s: %s\n", ICP_SLOT_COUNT_FILE, strerror(errno));
+		error("%s: %s\n", path, strerror(errno));
 		return -1;
 	}
 	sz = read(fd, buff, 255);
 	close(fd);
 	if (0 == sz || 255 <= sz) {
-		error("%s: %s\n", ICP_SLOT_COUNT_FILE, strerror(errno));
+		error("%s: %s\n", path, strerror(errno));
 		return -1;
 	}
+	buff[sz] = 0;
 
 	return atoi(buff);
 }
 
 static int
-icpdas_get_parallel_name(unsigned int slot, int size, char *data)
+icpdas_sysfs_module_name(unsigned int slot, int size, char *data)
 {
 	int fd, err;
 	char buff[256];
@@ -65,7 +139,7 @@ icpdas_get_parallel_name(unsigned int slot, int size, char *data)
 		return -1;
 	}
 	err = snprintf(&buff[0], sizeof(buff) - 1,
-			"/sys/bus/icpdas/devices/slot%02u/model", slot);
+			"%s/slot%02u/model", icpdas_sysfs_root, slot);
 	if (err >= sizeof(buff)) {
 		error("%s:%u: %s (%i)\n", __FILE__, __LINE__, strerror(errno),
 				errno);
@@ -87,194 +161,198 @@ icpdas_get_parallel_name(unsigned int slot, int size, char *data)
 }
 
 #define MAX_RESPONSE	256
-#define REQUEST_NAME	"$00M"
-void
-icpdas_list_modules(void (*callback)(unsigned int, const char *))
-{
-	char buff[MAX_RESPONSE];
-	int slot_count, slot;
 
-	slot_count = icpdas_module_count();
-	if (slot_count < 0)
-		return;
+/*
+ * Slot attribute files stay open once used. sysfs regenerates an
+ * attribute on every read at offset 0, so each access is one pread or
+ * pwrite. A failed access closes the file, and the next one reopens it.
+ */
+const char *const icpdas_attr_names[ICP_ATTR_COUNT] = {
+	[ICP_INPUT_STATUS]	= "input_status",
+	[ICP_OUTPUT_STATUS]	= "output_status",
+	[ICP_ANALOG_OUTPUT]	= "analog_output",
+	[ICP_RESET]		= "reset",
+};
 
-	for (slot = 1; slot <= slot_count; slot++) {
-		char *name = buff;
-		if (icpdas_get_parallel_name(slot, MAX_RESPONSE, name) != 0) {
-			if (icpdas_serial_exchange("/dev/ttyS1", slot,
-						REQUEST_NAME,
-						MAX_RESPONSE - 1, name) < 3)
-				name = NULL;
-			else
-				name = &buff[3];
-		}
-		callback(slot, name);
-	}
-}
+static const int icpdas_attr_flags[ICP_ATTR_COUNT] = {
+	[ICP_INPUT_STATUS]	= O_RDONLY,
+	[ICP_OUTPUT_STATUS]	= O_RDWR,
+	[ICP_ANALOG_OUTPUT]	= O_RDWR,
+	[ICP_RESET]		= O_WRONLY,
+};
 
-int
-icpdas_get_parallel_input(unsigned int slot, unsigned long *out)
+/* Holds fd + 1, so that zero means closed */
+static int icpdas_slot_fds[8][ICP_ATTR_COUNT];
+
+static int
+icpdas_slot_open(unsigned int slot, enum icpdas_attr attr)
 {
+	int *cache = &icpdas_slot_fds[slot - 1][attr];
 	int fd, err;
 	char buff[256];
-	char *p;
 
-	if (slot == 0 || slot > 8) {
-		error("%s %u: bad slot (%u)\n", __FILE__, __LINE__, slot);
-		return -1;
-	}
+	fd = *cache - 1;
+	if (0 <= fd)
+		return fd;
+
 	err = snprintf(&buff[0], sizeof(buff) - 1,
-			"/sys/bus/icpdas/devices/slot%02u/input_status", slot);
+			"%s/slot%02u/%s", icpdas_sysfs_root, slot,
+			icpdas_attr_names[attr]);
 	if (err >= sizeof(buff)) {
 		error("%s %u: %s (%i)\n", __FILE__, __LINE__, strerror(errno),
 				errno);
 		return -1;
 	}
-	fd = open(buff, O_RDONLY);
+	fd = open(buff, icpdas_attr_flags[attr]);
 	if (-1 == fd) {
-		error("%s %u: %s (%i)\n", __FILE__, __LINE__, strerror(errno),
-				errno);
+		error("%s: %s (%i)\n", buff, strerror(errno), errno);
 		return -1;
 	}
 
-	err = read(fd, buff, 256);
-	if(0 > err) {
-		error("%s %u: %s (%i)\n", __FILE__, __LINE__,
-				strerror(errno), errno);
-		goto close_fd;
+	/* Another thread may have opened the same attribute meanwhile */
+	if (!__sync_bool_compare_and_swap(cache, 0, fd + 1)) {
+		close(fd);
+		fd = *cache - 1;
 	}
+	return fd;
+}
 
-	err = 0;
-	*out = strtoul(buff, &p, 16);
-close_fd:
-	close(fd);
-	return err;
+static void
+icpdas_slot_close(unsigned int slot, enum icpdas_attr attr, int fd)
+{
+	int *cache = &icpdas_slot_fds[slot - 1][attr];
+
+	if (__sync_bool_compare_and_swap(cache, fd + 1, 0))
+		close(fd);
 }
 
-int
-icpdas_get_parallel_output(unsigned int slot, unsigned long *out)
+static int
+icpdas_sysfs_read(unsigned int slot, enum icpdas_attr attr, int size,
+		char *data)
 {
 	int fd, err;
-	char buff[256];
-	char *p;
 
-	if (slot == 0 || slot > 8) {
-		error("%s %u: bad slot (%u)\n", __FILE__, __LINE__, slot);
+	fd = icpdas_slot_open(slot, attr);
+	if (0 > fd)
 		return -1;
-	}
-	err = snprintf(&buff[0], sizeof(buff) - 1,
-			"/sys/bus/icpdas/devices/slot%02u/output_status", slot);
-	if (err >= sizeof(buff)) {
-		error("%s %u: %s (%i)\n", __FILE__, __LINE__, strerror(errno),
-				errno);
+
+	err = pread(fd, data, size - 1, 0);
+	if (0 > err) {
+		error("slot%02u/%s: %s (%i)\n", slot, icpdas_attr_names[attr],
+				strerror(errno), errno);
+		icpdas_slot_close(slot, attr, fd);
 		return -1;
 	}
-	fd = open(buff, O_RDONLY);
-	if (-1 == fd) {
-		error("%s %u: %s (%i)\n", __FILE__, __LINE__, strerror(errno),
-				errno);
+	data[err] = 0;
+	return err;
+}
+
+static int
+icpdas_sysfs_write(unsigned int slot, enum icpdas_attr attr,
+		const char *data, int size)
+{
+	int fd, err;
+
+	fd = icpdas_slot_open(slot, attr);
+	if (0 > fd)
 		return -1;
-	}
 
-	err = read(fd, buff, 256);
-	if(0 > err) {
-		error("%s %u: %s (%i)\n", __FILE__, __LINE__,
+	err = pwrite(fd, data, size, 0);
+	if (0 > err) {
+		error("slot%02u/%s: %s (%i)\n", slot, icpdas_attr_names[attr],
 				strerror(errno), errno);
-		goto close_fd;
+		icpdas_slot_close(slot, attr, fd);
+		return -1;
 	}
+	return 0;
+}
 
-	err = 0;
-	*out = strtoul(buff, &p, 16);
-close_fd:
-	close(fd);
+static int
+icpdas_slot_read(unsigned int slot, enum icpdas_attr attr, int size,
+		char *data)
+{
+	int err;
+
+	err = icpdas_backend->read(slot, attr, size, data);
+	if (0 > err || !icpdas_capture)
+		return err;
+	fprintf(icpdas_capture, "parallel %u %s %.*s\n", slot,
+			icpdas_attr_names[attr], (int) strcspn(data, " \n"),
+			data);
 	return err;
 }
 
-int
-icpdas_set_parallel_output(unsigned int slot, unsigned long out)
+static int
+icpdas_slot_write(unsigned int slot, enum icpdas_attr attr,
+		const char *data, int size)
+{
+	return icpdas_backend->write(slot, attr, data, size);
+}
+
+static int
+icpdas_get_parallel_status(unsigned int slot, enum icpdas_attr attr,
+		unsigned long *out)
 {
-	int fd, err;
 	char buff[256];
+	char *p;
 
 	if (slot == 0 || slot > 8) {
 		error("%s %u: bad slot (%u)\n", __FILE__, __LINE__, slot);
 		return -1;
 	}
-	err = snprintf(&buff[0], sizeof(buff) - 1,
-			"/sys/bus/icpdas/devices/slot%02u/output_status", slot);
-	if (err >= sizeof(buff)) {
-		error("%s %u: %s (%i)\n", __FILE__, __LINE__, strerror(errno),
-				errno);
-		return -1;
-	}
-	fd = open(buff, O_RDWR);
-	if (-1 == fd) {
-		error("%s %u: %s (%i)\n", __FILE__, __LINE__, strerror(errno),
-				errno);
+	if (0 > icpdas_slot_read(slot, attr, sizeof(buff), buff))
 		return -1;
-	}
 
-	err = snprintf(&buff[0], sizeof(buff) - 1, "0x%08lx", out);
-	if (err >= sizeof(buff)) {
-		error("%s %u: %s (%i)\n", __FILE__, __LINE__, strerror(errno),
-				errno);
-		return -1;
-	}
-	err = write(fd, buff, err);
-	if(0 > err) {
-		error("%s %u: %s (%i)\n", __FILE__, __LINE__,
-				strerror(errno), errno);
-		goto close_fd;
-	}
+	*out = strtoul(buff, &p, 16);
+	return 0;
+}
 
-	err = 0;
-close_fd:
-	close(fd);
-	return err;
+int
+icpdas_get_parallel_input(unsigned int slot, unsigned long *out)
+{
+	return icpdas_get_parallel_status(slot, ICP_INPUT_STATUS, out);
 }
 
 int
-icpdas_reset_parallel_analog_output(unsigned int slot)
+icpdas_get_parallel_output(unsigned int slot, unsigned long *out)
 {
-	int fd, err;
+	return icpdas_get_parallel_status(slot, ICP_OUTPUT_STATUS, out);
+}
+
+int
+icpdas_set_parallel_output(unsigned int slot, unsigned long out)
+{
+	int err;
 	char buff[256];
 
 	if (slot == 0 || slot > 8) {
 		error("%s %u: bad slot (%u)\n", __FILE__, __LINE__, slot);
 		return -1;
 	}
-	err = snprintf(&buff[0], sizeof(buff) - 1,
-			"/sys/bus/icpdas/devices/slot%02u/reset", slot);
+	err = snprintf(&buff[0], sizeof(buff) - 1, "0x%08lx", out);
 	if (err >= sizeof(buff)) {
 		error("%s %u: %s (%i)\n", __FILE__, __LINE__, strerror(errno),
 				errno);
 		return -1;
 	}
-	fd = open(buff, O_WRONLY);
-	if (-1 == fd) {
-		error("%s %u: %s (%i)\n", __FILE__, __LINE__, strerror(errno),
-				errno);
-		return -1;
-	}
+	return icpdas_slot_write(slot, ICP_OUTPUT_STATUS, buff, err);
+}
 
-	err = write(fd, "1", 1);
-	if(0 > err) {
-		error("%s %u: %s (%i)\n", __FILE__, __LINE__,
-				strerror(errno), errno);
-		goto close_fd;
+int
+icpdas_reset_parallel_analog_output(unsigned int slot)
+{
+	if (slot == 0 || slot > 8) {
+		error("%s %u: bad slot (%u)\n", __FILE__, __LINE__, slot);
+		return -1;
 	}
-
-	err = 0;
-close_fd:
-	close(fd);
-	return err;
+	return icpdas_slot_write(slot, ICP_RESET, "1", 1);
 }
 
 int
 icpdas_set_parallel_analog_output(unsigned int slot, unsigned int port,
 		long value)
 {
-	int fd, err;
+	int err;
 	unsigned int data = ((unsigned int) value) + 0x2000;
 	char buff[256];
 
@@ -287,19 +365,6 @@ icpdas_set_parallel_analog_output(unsigned int slot, unsigned int port,
 		error("%s %u: bad slot (%u)\n", __FILE__, __LINE__, slot);
 		return -1;
 	}
-	err = snprintf(&buff[0], sizeof(buff) - 1,
-			"/sys/bus/icpdas/devices/slot%02u/analog_output", slot);
-	if (err >= sizeof(buff)) {
-		error("%s %u: %s (%i)\n", __FILE__, __LINE__, strerror(errno),
-				errno);
-		return -1;
-	}
-	fd = open(buff, O_RDWR);
-	if (-1 == fd) {
-		error("%s %u: %s (%i)\n", __FILE__, __LINE__, strerror(errno),
-				errno);
-		return -1;
-	}
 
 	data |= ((unsigned int) port) << 14;
 	err = snprintf(&buff[0], sizeof(buff) - 1, "0x%04x", data);
@@ -308,63 +373,181 @@ icpdas_set_parallel_analog_output(unsigned int slot, unsigned int port,
 				errno);
 		return -1;
 	}
-	err = write(fd, buff, err);
-	if(0 > err) {
-		error("%s %u: %s (%i)\n", __FILE__, __LINE__,
-				strerror(errno), errno);
-		goto close_fd;
-	}
-
-	err = 0;
-close_fd:
-	close(fd);
-	return err;
+	return icpdas_slot_write(slot, ICP_ANALOG_OUTPUT, buff, err);
 }
 
+/*
+ * Output blocks stage their values during the tick, and the main loop
+ * commits them in slot order once all blocks have run. A failed write
+ * invalidates the shadows of the blocks which staged it.
+ *
+ * Several blocks may drive disjoint bits of one digital slot. Each
+ * stages the bits of its mask, and they are merged into a single write.
+ * Bits nobody staged keep the value the module outputs now.
+ */
+#define ICP_STAGED_DIGITAL	0x10
+#define ICP_STAGED_SHADOWS	32
+#define ICP_DIGITAL_ALL		0xffffffffUL
+
+struct icpdas_staged {
+	unsigned int		pending;
+	unsigned long		digital;
+	unsigned long		digital_mask;
+	unsigned int		digital_shadows;
+	struct shadow		*digital_shadow[ICP_STAGED_SHADOWS];
+	long			analog[4];
+	struct shadow		*analog_shadow[4];
+};
+
+static struct icpdas_staged icpdas_staged[8];
+
 int
-icpdas_serial_exchange(const char const *device, unsigned int slot,
-		const char const *cmd, int size, char *data)
+icpdas_stage_parallel_output(unsigned int slot, unsigned long out,
+		unsigned long mask, struct shadow *sh)
 {
-	int fd, active_port_fd, err;
-	struct termios options;
-	char buff[4];
-	int i = 0;
+	struct icpdas_staged *st;
 
-	if (slot > 8) {
-		error("%s: bad slot (%u)\n", __FUNCTION__, slot);
+	if (slot == 0 || slot > 8) {
+		error("%s %u: bad slot (%u)\n", __FILE__, __LINE__, slot);
 		return -1;
 	}
-	err = snprintf(&buff[0], sizeof(buff) - 1, "%u", slot);
-	if (err >= sizeof(buff)) {
-		error("%s: %s (%i) on string operation\n",
-				__FUNCTION__, strerror(errno), errno);
+	st = &icpdas_staged[slot - 1];
+	if (!(st->pending & ICP_STAGED_DIGITAL)) {
+		st->digital_mask = 0;
+		st->digital_shadows = 0;
+	}
+	if (sh && st->digital_shadows == ICP_STAGED_SHADOWS) {
+		error("%s %u: too many outputs on slot %u\n", __FILE__,
+				__LINE__, slot);
+		return -1;
+	}
+	st->digital = (st->digital & ~mask) | (out & mask);
+	st->digital_mask |= mask;
+	if (sh)
+		st->digital_shadow[st->digital_shadows++] = sh;
+	st->pending |= ICP_STAGED_DIGITAL;
+	return 0;
+}
+
+int
+icpdas_stage_parallel_analog_output(unsigned int slot, unsigned int port,
+		long value, struct shadow *sh)
+{
+	struct icpdas_staged *st;
+
+	if (slot == 0 || slot > 8 || port > 3) {
+		error("%s %u: bad slot (%u) or port (%u)\n", __FILE__,
+				__LINE__, slot, port);
 		return -1;
 	}
-	fd = open(device, O_RDWR | O_NOCTTY);
+	st = &icpdas_staged[slot - 1];
+	st->analog[port] = value;
+	st->analog_shadow[port] = sh;
+	st->pending |= 1 << port;
+	return 0;
+}
+
+static void
+icpdas_commit_digital(unsigned int slot, struct icpdas_staged *st)
+{
+	unsigned long out = st->digital, now;
+	unsigned int i;
+
+	if (ICP_DIGITAL_ALL != (st->digital_mask & ICP_DIGITAL_ALL)) {
+		if (0 > icpdas_get_parallel_output(slot, &now))
+			goto invalidate;
+		out = (now & ~st->digital_mask) | (out & st->digital_mask);
+	}
+	if (0 <= icpdas_set_parallel_output(slot, out))
+		return;
+invalidate:
+	for (i = 0; i < st->digital_shadows; i++)
+		shadow_invalidate(st->digital_shadow[i]);
+}
+
+void
+icpdas_commit_outputs(void)
+{
+	struct icpdas_staged *st;
+	unsigned int slot, port;
+
+	for (slot = 1; slot <= 8; slot++) {
+		st = &icpdas_staged[slot - 1];
+		if (!st->pending)
+			continue;
+		if (st->pending & ICP_STAGED_DIGITAL)
+			icpdas_commit_digital(slot, st);
+		for (port = 0; port < 4; port++) {
+			if (!(st->pending & (1 << port)))
+				continue;
+			if (0 > icpdas_set_parallel_analog_output(slot, port,
+						st->analog[port]) &&
+					st->analog_shadow[port])
+				shadow_invalidate(st->analog_shadow[port]);
+		}
+		st->pending = 0;
+	}
+}
+
+#define ICP_BAUD	B115200
+#define ICP_BAUD_RATE	115200
+/* Time a module may take to start its reply until it has a history */
+#define ICP_TURNAROUND_USEC	2000
+#define ICP_MIN_TURNAROUND_USEC	300
+#define ICP_MAX_TURNAROUND_USEC	50000
+#define ICP_SAMPLES_UPDATE	16
+
+static struct icpdas_bus *icpdas_buses;
+static pthread_mutex_t icpdas_buses_lock = PTHREAD_MUTEX_INITIALIZER;
+
+static struct icpdas_bus *
+icpdas_bus_get(const char const *device)
+{
+	struct icpdas_bus *bus;
+
+	pthread_mutex_lock(&icpdas_buses_lock);
+	for (bus = icpdas_buses; bus; bus = bus->next)
+		if (!strcmp(bus->device, device))
+			break;
+	if (!bus) {
+		bus = xzalloc(sizeof(*bus));
+		bus->device = strdup(device);
+		bus->fd = -1;
+		pthread_mutex_init(&bus->port, NULL);
+		pthread_mutex_init(&bus->lock, NULL);
+		pthread_mutex_init(&bus->stats_lock, NULL);
+		pthread_cond_init(&bus->cond, NULL);
+		bus->next = icpdas_buses;
+		icpdas_buses = bus;
+	}
+	pthread_mutex_unlock(&icpdas_buses_lock);
+	return bus;
+}
+
+static void
+icpdas_bus_reset(struct icpdas_bus *bus)
+{
+	if (0 > bus->fd)
+		return;
+	close(bus->fd);
+	bus->fd = -1;
+	bus->rx_len = 0;
+	bus->stale = 0;
+}
+
+static int
+icpdas_bus_open(struct icpdas_bus *bus)
+{
+	const char *device = bus->device;
+	struct termios options;
+	int fd, err;
+
+	fd = open(device, O_RDWR | O_NOCTTY | O_NONBLOCK);
 	if (-1 == fd) {
 		error("%s: %s (%i) when openning port\n",
 				device, strerror(errno), errno);
 		return -1;
 	}
-	if (slot > 0) {
-		active_port_fd = open(ICP_ACTIVE_SLOT_FILE, O_RDWR);
-		if (-1 == active_port_fd) {
-			error("%s: %s (%i) when openning slot file\n",
-					ICP_ACTIVE_SLOT_FILE, strerror(errno),
-					errno);
-			err = -1;
-			goto close_fd;
-		}
-		debug3("%s: writing %s\n", ICP_ACTIVE_SLOT_FILE, buff);
-		err = write(active_port_fd, buff, 2);
-		if (err <= 0) {
-			error("%s: %s (%i) when writing slot index\n",
-					ICP_ACTIVE_SLOT_FILE, strerror(errno),
-					errno);
-			goto close_fd;
-		}
-		close(active_port_fd);
-	}
 
 	err = tcgetattr(fd, &options);
 	if (err < 0) {
@@ -373,8 +556,8 @@ icpdas_serial_exchange(const char const *device, unsigned int slot,
 		goto close_fd;
 	}
 
-	cfsetispeed(&options, B115200);
-	cfsetospeed(&options, B115200);
+	cfsetispeed(&options, ICP_BAUD);
+	cfsetospeed(&options, ICP_BAUD);
 
 	options.c_cflag &= ~CSIZE;
 	options.c_cflag |= CS8;
@@ -411,7 +594,7 @@ icpdas_serial_exchange(const char const *device, unsigned int slot,
 	options.c_cc[VERASE] = 0;
 	options.c_cc[VKILL] = 0;
 	options.c_cc[VEOF] = 4;
-	options.c_cc[VTIME] = 1;
+	options.c_cc[VTIME] = 0;
 	options.c_cc[VMIN] = 0;
 	options.c_cc[VSWTC] = 0;
 	options.c_cc[VSTART] = 0;
@@ -431,55 +614,948 @@ icpdas_serial_exchange(const char const *device, unsigned int slot,
 		goto close_fd;
 	}
 
-	err = write(fd, cmd, strlen(cmd));
-	debug3("%s: sent %s\n", device, cmd);
-	if (0 > err) {
-		error("%s: %s (%i) when sending command\n",
-				device, strerror(errno), errno);
-		goto close_fd;
-	}
+	bus->fd = fd;
+	return 0;
 
-	err = write(fd, "\r", 1);
-	if (0 > err) {
-		error("%s: %s (%i) when finishing command\n",
-				device, strerror(errno), errno);
-		goto close_fd;
-	}
+close_fd:
+	close(fd);
+	return -1;
+}
+
+/*
+ * Reads one CR terminated frame into data before the deadline. Returns
+ * its length, or -1 after an error or a timeout. A line which hangs up
+ * stays ready to poll, so that is an error too, and the bus is reopened.
+ */
+static int
+icpdas_bus_read_frame(struct icpdas_bus *bus, const struct timespec *deadline,
+		int size, char *data)
+{
+	struct pollfd pfd = {
+		.fd		= bus->fd,
+		.events		= POLLIN,
+	};
+	struct timespec now, left;
+	char *end;
+	int err, len;
+	long usec;
 
 	while (1) {
-		err = read(fd, buff, 1);
-		if (0 > err) {
-			error("%s: %s (%i) when reading reply\n",
-					device, strerror(errno), errno);
-			goto close_fd;
-		} else if (0 == err) {
-			err = -1;
-			debug("%s: timeout when reading reply\n",
-					device);
-			goto close_fd;
-		}
-		if (buff[0] == 13)
+		end = memchr(bus->rx, 13, bus->rx_len);
+		if (end)
 			break;
-		data[i++] = buff[0];
-		if (i == size) {
+		if (bus->rx_len == ICP_RX_SIZE) {
 			error("%s: reply is too long (%i)\n",
-					__FUNCTION__, i);
-			err = -1;
-			goto close_fd;
+					bus->device, bus->rx_len);
+			return -1;
+		}
+		pcs_clock_now(&now);
+		usec = pcs_clock_diff(deadline, &now);
+		if (0 >= usec) {
+			debug("%s: timeout when reading reply\n",
+					bus->device);
+			bus->stale = 1;
+			return -1;
+		}
+		left.tv_sec = usec / 1000000;
+		left.tv_nsec = (usec % 1000000) * 1000;
+		err = ppoll(&pfd, 1, &left, NULL);
+		if (0 > err && EINTR != errno) {
+			error("%s: %s (%i) when waiting for reply\n",
+					bus->device, strerror(errno), errno);
+			return -1;
+		}
+		if (0 >= err)
+			continue;
+		if (pfd.revents & (POLLERR | POLLNVAL)) {
+			error("%s: error when waiting for reply\n",
+					bus->device);
+			return -1;
+		}
+		err = read(bus->fd, &bus->rx[bus->rx_len],
+				ICP_RX_SIZE - bus->rx_len);
+		if (0 > err && EAGAIN != errno && EINTR != errno) {
+			error("%s: %s (%i) when reading reply\n",
+					bus->device, strerror(errno), errno);
+			return -1;
+		}
+		/* Nothing to read from a ready line means it has hung up */
+		if (0 == err) {
+			error("%s: hang-up when reading reply\n",
+					bus->device);
+			return -1;
 		}
+		if (0 < err)
+			bus->rx_len += err;
+	}
+
+	len = end - bus->rx;
+	if (len >= size) {
+		error("%s: reply is too long (%i)\n", __FUNCTION__, len);
+		return -1;
+	}
+	memcpy(data, bus->rx, len);
+	data[len] = 0;
+
+	bus->rx_len -= len + 1;
+	memmove(bus->rx, end + 1, bus->rx_len);
+	return len;
+}
+
+/*
+ * The backplane routes the serial line to one slot at a time. The
+ * selected slot is remembered, so back-to-back exchanges with the same
+ * slot skip the write. Buses run on their own workers, so the lock is
+ * held from a successful select until the reply to the slot is read.
+ */
+static int icpdas_active_slot_fd = -1;
+static unsigned int icpdas_active_slot;
+static pthread_mutex_t icpdas_active_slot_lock = PTHREAD_MUTEX_INITIALIZER;
+
+static int
+icpdas_select_slot(unsigned int slot)
+{
+	int err = 0;
+	char buff[4], path[256];
+
+	pthread_mutex_lock(&icpdas_active_slot_lock);
+	if (slot == icpdas_active_slot)
+		return 0;
+
+	err = snprintf(&buff[0], sizeof(buff) - 1, "%u", slot);
+	if (err >= sizeof(buff)) {
+		error("%s: %s (%i) on string operation\n",
+				__FUNCTION__, strerror(errno), errno);
+		err = -1;
+		goto unlock;
+	}
+	snprintf(path, sizeof(path), ICP_ACTIVE_SLOT_FILE, icpdas_sysfs_root);
+	if (0 > icpdas_active_slot_fd)
+		icpdas_active_slot_fd = open(path, O_RDWR);
+	if (0 > icpdas_active_slot_fd) {
+		error("%s: %s (%i) when openning slot file\n",
+				path, strerror(errno),
+				errno);
+		err = -1;
+		goto unlock;
+	}
+	debug3("%s: writing %s\n", path, buff);
+	err = pwrite(icpdas_active_slot_fd, buff, 2, 0);
+	if (err <= 0) {
+		error("%s: %s (%i) when writing slot index\n",
+				path, strerror(errno),
+				errno);
+		close(icpdas_active_slot_fd);
+		icpdas_active_slot_fd = -1;
+		icpdas_active_slot = 0;
+		err = -1;
+		goto unlock;
+	}
+	icpdas_active_slot = slot;
+	return 0;
+unlock:
+	pthread_mutex_unlock(&icpdas_active_slot_lock);
+	return err;
+}
+
+long
+icpdas_wire_usec(int chars)
+{
+	return chars * 10 * 1000000L / ICP_BAUD_RATE;
+}
+
+static int
+icpdas_cmp_long(const void *a, const void *b)
+{
+	long x = *(const long *) a, y = *(const long *) b;
+
+	return x < y ? -1 : x > y;
+}
+
+static void
+icpdas_stats_reply(struct icpdas_slot_stats *st, long usec)
+{
+	long sorted[ICP_SAMPLES];
+	unsigned int n;
+
+	if (0 > usec)
+		usec = 0;
+	st->samples[st->count % ICP_SAMPLES] = usec;
+	st->count++;
+	if (st->count % ICP_SAMPLES_UPDATE)
+		return;
+
+	n = st->count < ICP_SAMPLES ? st->count : ICP_SAMPLES;
+	memcpy(sorted, st->samples, n * sizeof(*sorted));
+	qsort(sorted, n, sizeof(*sorted), icpdas_cmp_long);
+	st->p50 = sorted[n / 2];
+	st->p99 = sorted[(n * 99) / 100];
+	st->turnaround = 2 * st->p99;
+	if (st->turnaround < ICP_MIN_TURNAROUND_USEC)
+		st->turnaround = ICP_MIN_TURNAROUND_USEC;
+}
+
+static void
+icpdas_stats_timeout(struct icpdas_slot_stats *st)
+{
+	st->timeouts++;
+	if (!st->turnaround)
+		return;
+	st->turnaround *= 2;
+	if (st->turnaround > ICP_MAX_TURNAROUND_USEC)
+		st->turnaround = ICP_MAX_TURNAROUND_USEC;
+}
+
+/*
+ * A request may take the time to send the command and receive the
+ * expected reply at the bus baud rate, plus the slot turnaround.
+ */
+static void
+icpdas_bus_deadline(struct icpdas_slot_stats *st, int chars,
+		const struct timespec *start, struct timespec *ts)
+{
+	struct timeval budget;
+	long usec;
+
+	usec = icpdas_wire_usec(chars);
+	usec += st->turnaround ? st->turnaround : ICP_TURNAROUND_USEC;
+	budget.tv_sec = usec / 1000000;
+	budget.tv_usec = usec % 1000000;
+	*ts = *start;
+	pcs_clock_add(ts, &budget);
+}
+
+static int
+icpdas_sysfs_select(struct icpdas_bus *bus, unsigned int slot)
+{
+	if (0 > bus->fd && 0 > icpdas_bus_open(bus))
+		return -1;
+	if (bus->stale) {
+		tcflush(bus->fd, TCIFLUSH);
+		bus->rx_len = 0;
+		bus->stale = 0;
+	}
+	if (!slot)
+		return 0;
+	return icpdas_select_slot(slot);
+}
+
+static int
+icpdas_sysfs_send(struct icpdas_bus *bus, const char *tx, int len,
+		int expect, const struct timespec *deadline, int size,
+		char *data)
+{
+	const char *device = bus->device;
+	int err;
+
+	err = write(bus->fd, tx, len);
+	if (len != err) {
+		error("%s: %s (%i) when sending command\n",
+				device, strerror(errno), errno);
+		goto reset;
+	}
+
+	/* The command has to leave the wire before another slot is selected */
+	if (0 > expect) {
+		if (!tcdrain(bus->fd))
+			return 0;
+		error("%s: %s (%i) when draining command\n",
+				device, strerror(errno), errno);
+		goto reset;
+	}
+
+	err = icpdas_bus_read_frame(bus, deadline, size, data);
+	if (0 <= err)
+		return err;
+	if (bus->stale)
+		return ICP_TIMEOUT;
+reset:
+	icpdas_bus_reset(bus);
+	return -1;
+}
+
+static int
+icpdas_sysfs_transfer(struct icpdas_bus *bus, unsigned int slot,
+		const char *tx, int len, int expect,
+		const struct timespec *deadline, int size, char *data)
+{
+	int err = icpdas_sysfs_send(bus, tx, len, expect, deadline, size,
+			data);
+
+	/* Releases the slot taken by icpdas_sysfs_select() */
+	if (slot)
+		pthread_mutex_unlock(&icpdas_active_slot_lock);
+	return err;
+}
+
+const struct icpdas_backend icpdas_sysfs_backend = {
+	.name		= "icpdas",
+	.module_count	= icpdas_sysfs_module_count,
+	.module_name	= icpdas_sysfs_module_name,
+	.read		= icpdas_sysfs_read,
+	.write		= icpdas_sysfs_write,
+	.select		= icpdas_sysfs_select,
+	.transfer	= icpdas_sysfs_transfer,
+};
+
+/*
+ * Sleeps usec from now, or until the deadline if that comes first.
+ * Returns ICP_TIMEOUT in the latter case.
+ */
+int
+icpdas_backend_wait(long usec, const struct timespec *deadline)
+{
+	struct timespec ready;
+	struct timeval tv = {
+		.tv_sec		= usec / 1000000,
+		.tv_usec	= usec % 1000000,
+	};
+	int late;
+
+	pcs_clock_now(&ready);
+	pcs_clock_add(&ready, &tv);
+	late = pcs_clock_diff(&ready, deadline) > 0;
+	if (late)
+		ready = *deadline;
+	while (EINTR == clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME,
+				&ready, NULL))
+		;
+	return late ? ICP_TIMEOUT : 0;
+}
+
+/*
+ * Called with bus->port held. expect is the expected reply length, zero
+ * when only the buffer size is known, or negative for a command without
+ * a reply.
+ */
+static int
+icpdas_bus_exchange(struct icpdas_bus *bus, unsigned int slot,
+		const char const *cmd, int expect, int size, char *data)
+{
+	const char *device = bus->device;
+	struct icpdas_slot_stats *st = &bus->stats[slot];
+	struct timespec start, deadline, now;
+	char tx[ICP_RX_SIZE];
+	int err, len;
+	long usec;
+
+	len = snprintf(tx, sizeof(tx), "%s\r", cmd);
+	if (len >= sizeof(tx)) {
+		error("%s: command is too long\n", device);
+		return -1;
+	}
+	if (icpdas_backend->select) {
+		err = icpdas_backend->select(bus, slot);
+		if (0 > err)
+			return err;
 	}
 
-	data[i] = 0;
-	err = i;
+	pcs_clock_now(&start);
+	icpdas_bus_deadline(st, len + (expect ? expect + 1 : size), &start,
+			&deadline);
+	debug3("%s: sending %s\n", device, cmd);
+	err = icpdas_backend->transfer(bus, slot, tx, len, expect, &deadline,
+			size, data);
+	if (0 > expect || (0 > err && ICP_TIMEOUT != err))
+		return err;
+
+	pcs_clock_now(&now);
+	usec = pcs_clock_diff(&now, &start);
+	if (icpdas_capture)
+		fprintf(icpdas_capture, "serial %s %u %li %s %s\n", device,
+				slot, usec, cmd, 0 > err ? "-" : data);
+	pthread_mutex_lock(&bus->stats_lock);
+	if (0 > err)
+		icpdas_stats_timeout(st);
+	else
+		icpdas_stats_reply(st, usec - icpdas_wire_usec(len + err + 1));
+	pthread_mutex_unlock(&bus->stats_lock);
+	if (0 > err)
+		return err;
+
 	if (slot)
 		debug2("%s:slot%u: read [%s]\n", device, slot, data);
 	else
 		debug2("%s: read [%s]\n", device, data);
-close_fd:
-	close(fd);
 	return err;
 }
 
+int
+icpdas_serial_exchange(const char const *device, unsigned int slot,
+		const char const *cmd, int size, char *data)
+{
+	struct icpdas_bus *bus;
+	int err;
+
+	if (slot > 8) {
+		error("%s: bad slot (%u)\n", __FUNCTION__, slot);
+		return -1;
+	}
+	bus = icpdas_bus_get(device);
+	pthread_mutex_lock(&bus->port);
+	err = icpdas_bus_exchange(bus, slot, cmd, 0, size, data);
+	pthread_mutex_unlock(&bus->port);
+	return err;
+}
+
+static int icpdas_batch;
+
+/*
+ * Sets the bus up ahead of time, so that the tick does not allocate.
+ * Analog modules are remembered for synchronized sampling.
+ */
+void
+icpdas_serial_attach(const char const *device, unsigned int slot,
+		int analog)
+{
+	struct icpdas_bus *bus = icpdas_bus_get(device);
+
+	if (analog && slot <= 8)
+		bus->sync_slots |= 1 << slot;
+}
+
+static int icpdas_sync;
+
+void
+icpdas_serial_sync_mode(int on)
+{
+	icpdas_sync = on;
+}
+
+int
+icpdas_serial_sync_enabled(void)
+{
+	return icpdas_sync;
+}
+
+static void
+icpdas_sync_done(struct icpdas_request *r, int err, const char *reply)
+{
+	if (0 > err)
+		error("%s: sampling trigger failed on slot %u\n",
+				(const char *) r->data, r->slot);
+}
+
+/* Marks an analog module to be read this tick, so it gets a trigger */
+void
+icpdas_serial_sync_slot(const char const *device, unsigned int slot)
+{
+	struct icpdas_bus *bus;
+
+	if (!icpdas_sync || slot > 8)
+		return;
+	bus = icpdas_bus_get(device);
+	bus->sync_due |= bus->sync_slots & (1 << slot);
+}
+
+/*
+ * Sends the DCON synchronized sampling command (#**) to every analog
+ * module marked this tick. The backplane routes the line to one slot at
+ * a time, so each trigger takes a slot select and a 4-character frame,
+ * about 0.35 ms at 115200 baud. Modules on a full backplane latch a few
+ * milliseconds apart, but all of them before the first read. They then
+ * answer $AA4 with the latched values. In batch mode the triggers queue
+ * ahead of any read.
+ */
+void
+icpdas_serial_sync(void)
+{
+	struct icpdas_bus *bus;
+	struct icpdas_request *r;
+	unsigned int slot;
+
+	if (!icpdas_sync)
+		return;
+
+	pthread_mutex_lock(&icpdas_buses_lock);
+	bus = icpdas_buses;
+	pthread_mutex_unlock(&icpdas_buses_lock);
+
+	for (; bus; bus = bus->next) {
+		for (slot = 0; slot <= 8; slot++) {
+			if (!(bus->sync_due & (1 << slot)))
+				continue;
+			r = &bus->trigger[slot];
+			r->slot = slot;
+			r->cmd = "#**";
+			r->reply_size = -1;
+			r->done = icpdas_sync_done;
+			r->data = bus->device;
+			icpdas_serial_submit(bus->device, r);
+		}
+		bus->sync_due = 0;
+	}
+}
+
+static void
+icpdas_bus_run(struct icpdas_bus *bus, struct icpdas_request *r)
+{
+	char data[MAX_RESPONSE];
+	int err;
+
+	pthread_mutex_lock(&bus->port);
+	err = icpdas_bus_exchange(bus, r->slot, r->cmd, r->reply_size,
+			MAX_RESPONSE, data);
+	pthread_mutex_unlock(&bus->port);
+	r->done(r, err, 0 > err ? NULL : data);
+}
+
+/* Drains the bus queue, lowest slot first, as requests arrive */
+static void *
+icpdas_bus_thread(void *data)
+{
+	struct icpdas_bus *bus = data;
+	struct icpdas_request *r;
+	sigset_t set;
+
+	sigfillset(&set);
+	pthread_sigmask(SIG_BLOCK, &set, NULL);
+
+	pthread_mutex_lock(&bus->lock);
+	while (1) {
+		while (!bus->queue && !bus->quit)
+			pthread_cond_wait(&bus->cond, &bus->lock);
+		if (!bus->queue)
+			break;
+		r = bus->queue;
+		bus->queue = r->next;
+		bus->busy = 1;
+		pthread_mutex_unlock(&bus->lock);
+
+		icpdas_bus_run(bus, r);
+
+		pthread_mutex_lock(&bus->lock);
+		bus->busy = 0;
+		pthread_cond_broadcast(&bus->cond);
+	}
+	pthread_mutex_unlock(&bus->lock);
+	return NULL;
+}
+
+/* Workers only exchange short frames, a small stack is plenty to lock */
+#define ICP_WORKER_STACK	(64 * 1024)
+
+/* Called with bus->lock held */
+static void
+icpdas_bus_start(struct icpdas_bus *bus)
+{
+	pthread_attr_t attr;
+	int err;
+
+	if (bus->worker)
+		return;
+	pthread_attr_init(&attr);
+	pthread_attr_setstacksize(&attr, ICP_WORKER_STACK);
+	err = pthread_create(&bus->tid, &attr, icpdas_bus_thread, bus);
+	pthread_attr_destroy(&attr);
+	if (err)
+		fatal("pthread_create: %s\n", strerror(err));
+	bus->worker = 1;
+}
+
+/*
+ * Starts the workers of the buses attached so far, so that the tick
+ * does not create threads. pcs turns batching on before its real-time
+ * setup.
+ */
+void
+icpdas_serial_batch(int on)
+{
+	struct icpdas_bus *bus;
+
+	icpdas_batch = on;
+	if (!on)
+		return;
+
+	pthread_mutex_lock(&icpdas_buses_lock);
+	bus = icpdas_buses;
+	pthread_mutex_unlock(&icpdas_buses_lock);
+
+	for (; bus; bus = bus->next) {
+		pthread_mutex_lock(&bus->lock);
+		icpdas_bus_start(bus);
+		pthread_mutex_unlock(&bus->lock);
+	}
+}
+
+/* Commands without a reply, such as sampling triggers, go first */
+static int
+icpdas_request_before(const struct icpdas_request *a,
+		const struct icpdas_request *b)
+{
+	if ((0 > a->reply_size) != (0 > b->reply_size))
+		return 0 > a->reply_size;
+	return a->slot < b->slot;
+}
+
+/*
+ * Without batching the request runs at once. With batching it goes to
+ * its bus queue, sorted by slot, and the bus worker runs it while the
+ * caller goes on. Each serial bus gets its own worker, so buses work in
+ * parallel with each other and with the caller.
+ */
+void
+icpdas_serial_submit(const char const *device, struct icpdas_request *r)
+{
+	struct icpdas_bus *bus;
+	struct icpdas_request **p;
+
+	if (r->slot > 8) {
+		error("%s: bad slot (%u)\n", __FUNCTION__, r->slot);
+		r->done(r, -1, NULL);
+		return;
+	}
+	bus = icpdas_bus_get(device);
+	if (!icpdas_batch) {
+		icpdas_bus_run(bus, r);
+		return;
+	}
+
+	pthread_mutex_lock(&bus->lock);
+	/* Only a bus nobody attached starts its worker this late */
+	icpdas_bus_start(bus);
+	for (p = &bus->queue; *p; p = &(*p)->next)
+		if (icpdas_request_before(r, *p))
+			break;
+	r->next = *p;
+	*p = r;
+	pthread_cond_broadcast(&bus->cond);
+	pthread_mutex_unlock(&bus->lock);
+}
+
+/*
+ * Writes one line per slot which has seen traffic: device, slot,
+ * replies, timeouts, median and p99 turnaround, and the current
+ * turnaround allowance, all times in usec.
+ */
+int
+icpdas_serial_save_stats(const char const *path)
+{
+	struct icpdas_slot_stats stats[9], *st;
+	struct icpdas_bus *bus;
+	unsigned int slot;
+	FILE *f;
+
+	f = fopen(path, "w");
+	if (!f) {
+		error("%s: %s (%i)\n", path, strerror(errno), errno);
+		return -1;
+	}
+
+	pthread_mutex_lock(&icpdas_buses_lock);
+	bus = icpdas_buses;
+	pthread_mutex_unlock(&icpdas_buses_lock);
+	for (; bus; bus = bus->next) {
+		/* Bus workers keep updating the stats while this runs */
+		pthread_mutex_lock(&bus->stats_lock);
+		memcpy(stats, bus->stats, sizeof(stats));
+		pthread_mutex_unlock(&bus->stats_lock);
+		for (slot = 0; slot < 9; slot++) {
+			st = &stats[slot];
+			if (!st->count && !st->timeouts)
+				continue;
+			fprintf(f, "%s %u %lu %lu %li %li %li\n", bus->device,
+					slot, st->count, st->timeouts,
+					st->p50, st->p99, st->turnaround ?
+					st->turnaround : ICP_TURNAROUND_USEC);
+		}
+	}
+	fclose(f);
+	return 0;
+}
+
+/* Removes a request which has not run yet from its bus queue */
+void
+icpdas_serial_cancel(const char const *device, struct icpdas_request *r)
+{
+	struct icpdas_bus *bus = icpdas_bus_get(device);
+	struct icpdas_request **p;
+
+	pthread_mutex_lock(&bus->lock);
+	for (p = &bus->queue; *p; p = &(*p)->next) {
+		if (*p != r)
+			continue;
+		*p = r->next;
+		break;
+	}
+	pthread_mutex_unlock(&bus->lock);
+}
+
+/* Waits until every bus has run all requests submitted so far */
+void
+icpdas_serial_flush(void)
+{
+	struct icpdas_bus *bus;
+
+	pthread_mutex_lock(&icpdas_buses_lock);
+	bus = icpdas_buses;
+	pthread_mutex_unlock(&icpdas_buses_lock);
+
+	for (; bus; bus = bus->next) {
+		pthread_mutex_lock(&bus->lock);
+		while (bus->queue || bus->busy)
+			pthread_cond_wait(&bus->cond, &bus->lock);
+		pthread_mutex_unlock(&bus->lock);
+	}
+}
+
+/*
+ * Stops the bus workers once their queues are empty. A worker does not
+ * survive fork(), so none may be left running before pcs daemonizes.
+ */
+static void
+icpdas_serial_stop(void)
+{
+	struct icpdas_bus *bus;
+
+	pthread_mutex_lock(&icpdas_buses_lock);
+	bus = icpdas_buses;
+	pthread_mutex_unlock(&icpdas_buses_lock);
+
+	for (; bus; bus = bus->next) {
+		pthread_mutex_lock(&bus->lock);
+		if (!bus->worker) {
+			pthread_mutex_unlock(&bus->lock);
+			continue;
+		}
+		bus->quit = 1;
+		pthread_cond_broadcast(&bus->cond);
+		pthread_mutex_unlock(&bus->lock);
+		pthread_join(bus->tid, NULL);
+		bus->worker = 0;
+		bus->quit = 0;
+	}
+}
+
+#define ICP_BACKPLANE_DEVICE	"/dev/ttyS1"
+#define ICP_PROBE_CMD		"$00M"
+/* Long enough for "!00" and any model name */
+#define ICP_PROBE_REPLY		12
+
+static void
+icpdas_probe_done(struct icpdas_request *r, int err, const char *reply)
+{
+	char *model = r->data;
+
+	if (0 <= err && '!' == reply[0] && strlen(reply) > 3)
+		snprintf(model, ICP_MODEL_SIZE, "%s", &reply[3]);
+}
+
+/*
+ * Parallel modules show up in sysfs, and serial modules answer $00M on
+ * the backplane port. The serial probes go to the bus worker first, so
+ * the port is busy while this thread reads sysfs, and a probe is
+ * dropped if sysfs names its slot before the worker gets to it.
+ */
+int
+icpdas_discover(struct icpdas_inventory *inv)
+{
+	struct icpdas_request probes[9];
+	char serial[9][ICP_MODEL_SIZE];
+	int batch = icpdas_batch, slot;
+
+	memset(inv, 0, sizeof(*inv));
+	if (!icpdas_backend->module_count) {
+		error("%s I/O cannot list modules\n", icpdas_backend->name);
+		return -1;
+	}
+	inv->slot_count = icpdas_backend->module_count();
+	if (inv->slot_count < 0)
+		return -1;
+	if (inv->slot_count > 8)
+		inv->slot_count = 8;
+
+	memset(serial, 0, sizeof(serial));
+	icpdas_serial_batch(1);
+	for (slot = 1; slot <= inv->slot_count; slot++) {
+		probes[slot].slot = slot;
+		probes[slot].cmd = ICP_PROBE_CMD;
+		probes[slot].reply_size = ICP_PROBE_REPLY;
+		probes[slot].done = icpdas_probe_done;
+		probes[slot].data = serial[slot];
+		icpdas_serial_submit(ICP_BACKPLANE_DEVICE, &probes[slot]);
+	}
+	for (slot = 1; slot <= inv->slot_count; slot++)
+		if (!icpdas_backend->module_name(slot, ICP_MODEL_SIZE,
+					inv->model[slot]))
+			icpdas_serial_cancel(ICP_BACKPLANE_DEVICE,
+					&probes[slot]);
+	icpdas_serial_flush();
+	icpdas_serial_stop();
+	icpdas_serial_batch(batch);
+
+	for (slot = 1; slot <= inv->slot_count; slot++)
+		if (!inv->model[slot][0])
+			memcpy(inv->model[slot], serial[slot], ICP_MODEL_SIZE);
+	return 0;
+}
+
+void
+icpdas_list_modules(void (*callback)(unsigned int, const char *))
+{
+	struct icpdas_inventory inv;
+	int slot;
+
+	if (icpdas_discover(&inv))
+		return;
+	for (slot = 1; slot <= inv.slot_count; slot++)
+		callback(slot, inv.model[slot][0] ? inv.model[slot] : NULL);
+}
+
+/*
+ * The inventory file is a "slots <count>" line, then a "<slot> <model>"
+ * line for every occupied slot. It is only good for a backplane with
+ * the same slot count.
+ */
+int
+icpdas_inventory_save(const char *path, const struct icpdas_inventory *inv)
+{
+	FILE *f;
+	int slot;
+
+	f = fopen(path, "w");
+	if (!f) {
+		error("%s: %s (%i)\n", path, strerror(errno), errno);
+		return -1;
+	}
+	fprintf(f, "slots %i\n", inv->slot_count);
+	for (slot = 1; slot <= inv->slot_count; slot++)
+		if (inv->model[slot][0])
+			fprintf(f, "%i %s\n", slot, inv->model[slot]);
+	fclose(f);
+	return 0;
+}
+
+int
+icpdas_inventory_load(const char *path, struct icpdas_inventory *inv)
+{
+	char model[ICP_MODEL_SIZE];
+	unsigned int slot;
+	FILE *f;
+	int err = 0;
+
+	memset(inv, 0, sizeof(*inv));
+	f = fopen(path, "r");
+	if (!f)
+		return -1;
+	if (1 != fscanf(f, "slots %i", &inv->slot_count) ||
+			inv->slot_count < 0 || inv->slot_count > 8)
+		err = -1;
+	while (!err && 2 == fscanf(f, "%u %15s", &slot, model)) {
+		if (!slot || slot > inv->slot_count) {
+			err = -1;
+			break;
+		}
+		memcpy(inv->model[slot], model, ICP_MODEL_SIZE);
+	}
+	if (!err && !feof(f))
+		err = -1;
+	fclose(f);
+	if (err)
+		error("%s: bad inventory\n", path);
+	return err;
+}
+
+/* Probes the slots and rewrites the cache at path, which may be NULL */
+int
+icpdas_inventory_refresh(const char *path, struct icpdas_inventory *inv)
+{
+	if (icpdas_discover(inv))
+		return -1;
+	if (path)
+		icpdas_inventory_save(path, inv);
+	return 0;
+}
+
+/*
+ * Returns the cached inventory if the backplane slot count matches it,
+ * or probes the slots and refreshes the cache. path may be NULL.
+ */
+int
+icpdas_inventory_get(const char *path, struct icpdas_inventory *inv)
+{
+	int count;
+
+	if (!icpdas_backend->module_count)
+		return -1;
+	count = icpdas_backend->module_count();
+	if (0 > count)
+		return -1;
+	if (count > 8)
+		count = 8;
+	if (path && !icpdas_inventory_load(path, inv) &&
+			inv->slot_count == count) {
+		debug("%s: %i slots\n", path, count);
+		return 0;
+	}
+	return icpdas_inventory_refresh(path, inv);
+}
+
+static char icpdas_expected[9][ICP_MODEL_SIZE];
+
+/* Notes the model a block drives in a backplane slot */
+void
+icpdas_expect_module(const char *device, unsigned int slot,
+		const char *model)
+{
+	if (slot == 0 || slot > 8)
+		return;
+	if (device && strcmp(device, ICP_BACKPLANE_DEVICE))
+		return;
+	snprintf(icpdas_expected[slot], ICP_MODEL_SIZE, "%s", model);
+}
+
+static int
+icpdas_match_modules(const struct icpdas_inventory *inv, int report)
+{
+	int slot, err = 0;
+
+	for (slot = 1; slot <= 8; slot++) {
+		if (!icpdas_expected[slot][0] ||
+				!strcmp(icpdas_expected[slot], inv->model[slot]))
+			continue;
+		if (report)
+			error("slot %i holds %s instead of %s\n", slot,
+					inv->model[slot][0] ?
+					inv->model[slot] : "nothing",
+					icpdas_expected[slot]);
+		err = -1;
+	}
+	return err;
+}
+
+/*
+ * Compares the slots blocks drive with the inventory. A cached
+ * inventory which does not match may predate a module swap, so the
+ * slots are probed again before giving up. Nothing is checked if the
+ * I/O backend cannot list modules.
+ */
+int
+icpdas_check_modules(const char *path)
+{
+	struct icpdas_inventory inv;
+	int slot;
+
+	for (slot = 1; slot <= 8; slot++)
+		if (icpdas_expected[slot][0])
+			break;
+	if (slot > 8)
+		return 0;
+	if (icpdas_inventory_get(path, &inv)) {
+		debug("%s I/O has no module inventory\n",
+				icpdas_backend->name);
+		return 0;
+	}
+	if (!icpdas_match_modules(&inv, 0))
+		return 0;
+	if (path) {
+		debug("%s: does not match, probing slots\n", path);
+		if (icpdas_inventory_refresh(path, &inv))
+			return -1;
+	}
+	return icpdas_match_modules(&inv, 1);
+}
+
 static int
 parse_signed_input(const char const *data, int size, long *buffer)
 {
@@ -523,6 +1599,65 @@ parse_signed_input(const char const *data, int size, long *buffer)
 	}
 }
 
+int
+icpdas_parse_analog_input(const char const *reply, int size, long *out)
+{
+	int err;
+
+	if ('>' != reply[0]) {
+		error("%s: malformed data %s\n", __FUNCTION__, reply);
+		return -1;
+	}
+	err = parse_signed_input(&reply[1], size, out);
+	if (size != err) {
+		error("%s: only %i of %i parsed in %s\n", __FUNCTION__, err,
+				size, reply);
+		return -1;
+	}
+	return 0;
+}
+
+/* Parses a reply to $AA4, which is >AAS(data) with S = 1 for new data */
+int
+icpdas_parse_sync_analog_input(const char const *reply, int size, long *out)
+{
+	int err;
+
+	if ('>' != reply[0] || strlen(reply) < 4) {
+		error("%s: malformed data %s\n", __FUNCTION__, reply);
+		return -1;
+	}
+	if ('1' != reply[3]) {
+		error("%s: stale data %s\n", __FUNCTION__, reply);
+		return -1;
+	}
+	err = parse_signed_input(&reply[4], size, out);
+	if (size != err) {
+		error("%s: only %i of %i parsed in %s\n", __FUNCTION__, err,
+				size, reply);
+		return -1;
+	}
+	return 0;
+}
+
+int
+icpdas_parse_digital_input(const char const *reply, unsigned long *out)
+{
+	char *p;
+
+	if ('>' != reply[0]) {
+		error("%s: malformed data %s\n", __FUNCTION__, reply);
+		return -1;
+	}
+
+	*out = strtoul(&reply[1], &p, 16);
+	if (p[0] != 0) {
+		error("%s: bad input: %s\n", __FUNCTION__, p);
+		return -1;
+	}
+	return 0;
+}
+
 int
 icpdas_get_serial_analog_input(const char const *device, unsigned int slot,
 		int size, long *out)
@@ -536,18 +1671,7 @@ icpdas_get_serial_analog_input(const char const *device, unsigned int slot,
 				device, slot);
 		return err;
 	}
-	if ('>' != data[0]) {
-		error("%s: malformed data on %s slot %i\n", __FUNCTION__,
-				device, slot);
-		return -1;
-	}
-	err = parse_signed_input(&data[1], size, out);
-	if (size != err) {
-		error("%s: only %i of %i parsed in %s\n", __FUNCTION__, err,
-				size, data);
-		return -1;
-	}
-	return 0;
+	return icpdas_parse_analog_input(data, size, out);
 }
 
 int
@@ -556,7 +1680,6 @@ icpdas_get_serial_digital_input(const char const *device, unsigned int slot,
 {
 	int err;
 	char data[256];
-	char *p;
 
 	err = icpdas_serial_exchange(device, slot, "@00", 256, &data[0]);
 	if (0 > err) {
@@ -564,16 +1687,5 @@ icpdas_get_serial_digital_input(const char const *device, unsigned int slot,
 				device, slot);
 		return err;
 	}
-	if ('>' != data[0]) {
-		error("%s: malformed data on %s slot %i\n", __FUNCTION__,
-				device, slot);
-		return -1;
-	}
-
-	*out = strtoul(&data[1], &p, 16);
-	if (p[0] != 0) {
-		error("%s: bad input: %s\n", __FUNCTION__, p);
-		return -1;
-	}
-	return 0;
+	return icpdas_parse_digital_input(data, out);
 }
@@ -20,9 +20,74 @@
 #ifndef _PCS_ICPDAS_H
 #define _PCS_ICPDAS_H
 
+struct shadow;
+
+#define ICP_STATS_FILE	PKGRUNDIR "/icpdas.stats"
+#define ICP_INVENTORY_FILE	PKGSTATEDIR "/icpdas.inventory"
+#define ICP_MODEL_SIZE	16
+
+/*
+ * A DCON request to run on a serial bus, reply is NULL after an error.
+ * reply_size is the expected reply length without CR, zero if unknown,
+ * negative if the command has no reply.
+ * The request times out when the reply takes longer than it would at
+ * the bus baud rate plus a short module turnaround.
+ */
+struct icpdas_request {
+	struct icpdas_request	*next;
+	unsigned int		slot;
+	const char		*cmd;
+	int			reply_size;
+	void			(*done)(struct icpdas_request *r, int err,
+					const char *reply);
+	void			*data;
+};
+
+void
+icpdas_sysfs_set_root(const char *root);
+int
+icpdas_io_setup(const char *backend, const char *file, const char *capture);
+int
+icpdas_sim_set_model(unsigned int slot, const char *model);
+int
+icpdas_sim_set_latency(unsigned int slot, long usec);
+int
+icpdas_sim_set_jitter(unsigned int slot, long usec);
+unsigned long
+icpdas_sim_writes(unsigned int slot);
+int
+icpdas_sim_set_inputs(unsigned int slot, unsigned long inputs);
+int
+icpdas_sim_set_signal(unsigned int slot, unsigned int channel,
+		const char *spec);
+int
+icpdas_sim_answer(unsigned int slot, const char *cmd, char *reply, int size,
+		long *latency);
 void
 icpdas_list_modules(void (*callback)(unsigned int, const char *));
 
+/* Model names of the backplane slots, empty for an empty slot */
+struct icpdas_inventory {
+	int			slot_count;
+	char			model[9][ICP_MODEL_SIZE];
+};
+
+int
+icpdas_discover(struct icpdas_inventory *inv);
+int
+icpdas_inventory_save(const char *path, const struct icpdas_inventory *inv);
+int
+icpdas_inventory_load(const char *path, struct icpdas_inventory *inv);
+int
+icpdas_inventory_refresh(const char *path, struct icpdas_inventory *inv);
+int
+icpdas_inventory_get(const char *path, struct icpdas_inventory *inv);
+void
+icpdas_expect_module(const char *device, unsigned int slot,
+		const char *model);
+int
+icpdas_check_modules(const char *path);
+
 int
 icpdas_get_parallel_input(unsigned int slot, unsigned long *out);
 
@@ -39,6 +104,14 @@ int
 icpdas_set_parallel_analog_output(unsigned int slot, unsigned int port,
 		long value);
 int
+icpdas_stage_parallel_output(unsigned int slot, unsigned long out,
+		unsigned long mask, struct shadow *sh);
+int
+icpdas_stage_parallel_analog_output(unsigned int slot, unsigned int port,
+		long value, struct shadow *sh);
+void
+icpdas_commit_outputs(void);
+int
 icpdas_get_serial_analog_input(const char const *device, unsigned int slot,
 		int size, long *out);
 int
@@ -47,4 +120,31 @@ icpdas_get_serial_digital_input(const char const *device, unsigned int slot,
 int
 icpdas_serial_exchange(const char const *device, unsigned int slot,
 		const char const *cmd, int size, char *data);
+int
+icpdas_parse_analog_input(const char const *reply, int size, long *out);
+int
+icpdas_parse_sync_analog_input(const char const *reply, int size, long *out);
+int
+icpdas_parse_digital_input(const char const *reply, unsigned long *out);
+void
+icpdas_serial_attach(const char const *device, unsigned int slot,
+		int analog);
+void
+icpdas_serial_sync_mode(int on);
+int
+icpdas_serial_sync_enabled(void);
+void
+icpdas_serial_sync(void);
+void
+icpdas_serial_sync_slot(const char const *device, unsigned int slot);
+void
+icpdas_serial_batch(int on);
+void
+icpdas_serial_submit(const char const *device, struct icpdas_request *r);
+void
+icpdas_serial_cancel(const char const *device, struct icpdas_request *r);
+void
+icpdas_serial_flush(void);
+int
+icpdas_serial_save_stats(const char const *path);
 #endif /* _PCS_ICPDAS_H */
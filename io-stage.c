@@ -0,0 +1,249 @@
+/* io-stage.c -- acquire hardware inputs ahead of the tick
+ * Copyright (C) 2014 Sergei Ianovich <ynvich@gmail.com>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 2 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public
+ * License along with this program; if not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+ * Boston, MA 02111-1307, USA.
+ */
+
+#include "includes.h"
+
+#include <pthread.h>
+#include <signal.h>
+#include <string.h>
+
+#include "block.h"
+#include "block_builder.h"
+#include "icpdas.h"
+#include "io-stage.h"
+#include "list.h"
+#include "modbus.h"
+#include "profile.h"
+#include "scheduler.h"
+#include "serverconf.h"
+#include "state.h"
+
+/*
+ * Input blocks run on their own thread and write into a back copy of
+ * their outputs. At the start of each tick the tick thread publishes the
+ * back copy into the registers the other blocks read, and lets the I/O
+ * thread acquire the inputs for the next tick.
+ */
+struct io_stage {
+	struct list_head	block_list;
+	struct scheduler	sched;
+	unsigned int		count;
+	struct block		**blocks;
+	long			**front;
+	pthread_t		tid;
+	pthread_mutex_t		lock;
+	pthread_cond_t		cond;
+	int			busy;
+	int			quit;
+	int			dump;
+	struct server_state	*s;
+};
+
+static int
+block_input(struct block *b)
+{
+	return b->builder && (b->builder->flags & PCS_BLOCK_INPUT);
+}
+
+/*
+ * Serial blocks only queue their requests, and the bus workers start on
+ * them at once. Running them first lets the serial buses work while
+ * this thread polls the parallel slots.
+ */
+static int
+block_serial(struct block *b)
+{
+	return b->builder && (b->builder->flags & PCS_BLOCK_SERIAL);
+}
+
+static void
+acquire(struct io_stage *io)
+{
+	struct block **run;
+	unsigned int i, n;
+
+	modbus_sync();
+	n = scheduler_next(&io->sched, &run);
+	scheduler_prepare(run, n, io->s);
+	icpdas_serial_sync();
+	for (i = 0; i < n; i++)
+		if (block_serial(run[i]))
+			profile_run(run[i], io->s);
+	for (i = 0; i < n; i++)
+		if (!block_serial(run[i]))
+			profile_run(run[i], io->s);
+	/* Modbus links are polled while the serial buses finish */
+	modbus_flush();
+	icpdas_serial_flush();
+}
+
+static void *
+io_thread(void *data)
+{
+	struct io_stage *io = data;
+	sigset_t set;
+	int dump;
+
+	sigfillset(&set);
+	pthread_sigmask(SIG_BLOCK, &set, NULL);
+
+	pthread_mutex_lock(&io->lock);
+	while (1) {
+		while (!io->busy && !io->quit)
+			pthread_cond_wait(&io->cond, &io->lock);
+		if (io->quit)
+			break;
+		dump = io->dump;
+		io->dump = 0;
+		pthread_mutex_unlock(&io->lock);
+
+		acquire(io);
+		/* Block stats are only consistent between acquisitions */
+		if (dump)
+			profile_dump(&io->block_list);
+
+		pthread_mutex_lock(&io->lock);
+		io->busy = 0;
+		pthread_cond_broadcast(&io->cond);
+	}
+	pthread_mutex_unlock(&io->lock);
+	return NULL;
+}
+
+/*
+ * Moves input blocks from the main block list to the I/O stage and
+ * points their outputs at a back copy allocated from the register file.
+ */
+struct io_stage *
+io_stage_init(struct server_config *c)
+{
+	struct io_stage *io;
+	struct block *b, *tmp;
+	unsigned int i = 0, regs = 0;
+
+	if (!c->async_input)
+		return NULL;
+
+	io = xzalloc(sizeof(*io));
+	INIT_LIST_HEAD(&io->block_list);
+	list_for_each_entry_safe(b, tmp, &c->block_list, block_entry) {
+		if (!block_input(b))
+			continue;
+		list_move_tail(&b->block_entry, &io->block_list);
+		regs += b->outputs_count;
+		io->count++;
+	}
+	if (!io->count) {
+		xfree(io);
+		return NULL;
+	}
+
+	if (c->regs_used + regs >= c->regs_count)
+		fatal("%i registers are not enough\n", c->regs_count);
+
+	io->blocks = xcalloc(io->count, sizeof(*io->blocks));
+	io->front = xcalloc(io->count, sizeof(*io->front));
+	list_for_each_entry(b, &io->block_list, block_entry) {
+		io->blocks[i] = b;
+		io->front[i] = b->outputs;
+		b->outputs = &c->regs[c->regs_used];
+		c->regs_used += b->outputs_count;
+		i++;
+	}
+	scheduler_init(&io->sched, &io->block_list);
+	debug("%u input blocks acquired asynchronously\n", io->count);
+	return io;
+}
+
+/*
+ * Asks the I/O thread to dump the stats of input blocks after the next
+ * acquisition, since it updates them while acquiring.
+ */
+void
+io_stage_dump(struct io_stage *io)
+{
+	if (!io)
+		return;
+
+	pthread_mutex_lock(&io->lock);
+	io->dump = 1;
+	pthread_mutex_unlock(&io->lock);
+}
+
+void
+io_stage_start(struct io_stage *io, struct server_state *s)
+{
+	int err;
+
+	if (!io)
+		return;
+
+	io->s = s;
+	io->busy = 1;
+	icpdas_serial_batch(1);
+	modbus_batch(1);
+	pthread_mutex_init(&io->lock, NULL);
+	pthread_cond_init(&io->cond, NULL);
+	err = pthread_create(&io->tid, NULL, io_thread, io);
+	if (err)
+		fatal("pthread_create: %s\n", strerror(err));
+}
+
+/*
+ * Waits for the running acquisition, publishes its results and starts
+ * the acquisition for the next tick.
+ */
+void
+io_stage_publish(struct io_stage *io)
+{
+	struct block *b;
+	unsigned int i;
+
+	if (!io)
+		return;
+
+	pthread_mutex_lock(&io->lock);
+	while (io->busy)
+		pthread_cond_wait(&io->cond, &io->lock);
+
+	for (i = 0; i < io->count; i++) {
+		b = io->blocks[i];
+		memcpy(io->front[i], b->outputs,
+				b->outputs_count * sizeof(*b->outputs));
+	}
+
+	io->busy = 1;
+	pthread_cond_broadcast(&io->cond);
+	pthread_mutex_unlock(&io->lock);
+}
+
+void
+io_stage_stop(struct io_stage *io)
+{
+	if (!io)
+		return;
+
+	pthread_mutex_lock(&io->lock);
+	while (io->busy)
+		pthread_cond_wait(&io->cond, &io->lock);
+	io->quit = 1;
+	pthread_cond_broadcast(&io->cond);
+	pthread_mutex_unlock(&io->lock);
+	pthread_join(io->tid, NULL);
+}
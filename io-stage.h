@@ -0,0 +1,43 @@
+/* io-stage.h -- acquire hardware inputs ahead of the tick
+ * Copyright (C) 2014 Sergei Ianovich <ynvich@gmail.com>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 2 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public
+ * License along with this program; if not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+ * Boston, MA 02111-1307, USA.
+ */   
+
+#ifndef _PCS_IO_STAGE_H
+#define _PCS_IO_STAGE_H
+
+#include "list.h"
+#include "serverconf.h"
+#include "state.h"
+
+struct io_stage;
+
+struct io_stage *
+io_stage_init(struct server_config *c);
+
+void
+io_stage_dump(struct io_stage *io);
+
+void
+io_stage_start(struct io_stage *io, struct server_state *s);
+
+void
+io_stage_publish(struct io_stage *io);
+
+void
+io_stage_stop(struct io_stage *io);
+#endif
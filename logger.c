@@ -98,6 +98,7 @@ static struct block_builder log_builder = {
 	.ops		= init,
 	.alloc		= alloc,
 	.inputs		= inputs,
+	.flags		= PCS_BLOCK_IO,
 };
 
 struct block_builder *
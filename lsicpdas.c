@@ -19,7 +19,10 @@
 
 #include "includes.h"
 
+#include <errno.h>
 #include <stdio.h>
+#include <string.h>
+#include <unistd.h>
 
 #include "icpdas.h"
 
@@ -28,11 +31,95 @@ void print_module(unsigned int slot, const char *name)
 	printf("slot %i ... %s\n", slot, name ? name : "empty");
 }
 
-int main(int argc, char *argv[])
+static void
+usage(int err)
 {
-	log_init("lsicpdas", LOG_NOTICE, LOG_DAEMON, 1);
+	fprintf(stderr, "Usage: lsicpdas [-r root] [-c [-i file]] "
+			"[-s [-f file]]\n");
+	fprintf(stderr, "       lsicpdas  -h\n");
+	exit(err);
+}
+
+/* Prints serial slot statistics saved by pcs on SIGUSR1 */
+static int
+print_stats(const char *path)
+{
+	char device[256];
+	unsigned int slot;
+	unsigned long count, timeouts;
+	long p50, p99, turnaround;
+	FILE *f;
 
-	icpdas_list_modules(print_module);
+	f = fopen(path, "r");
+	if (!f) {
+		error("%s: %s (%i)\n", path, strerror(errno), errno);
+		return 1;
+	}
+	while (7 == fscanf(f, "%255s %u %lu %lu %li %li %li", device, &slot,
+				&count, &timeouts, &p50, &p99, &turnaround))
+		printf("slot %u on %s ... %lu replies, %lu timeouts, "
+				"median %li us, p99 %li us, timeout %li us\n",
+				slot, device, count, timeouts, p50, p99,
+				turnaround);
+	fclose(f);
+	return 0;
+}
+
+/*
+ * Prints the inventory pcs checks its configuration against. The
+ * cached one is probed again if the backplane slot count changed, and a
+ * live probe rewrites the cache.
+ */
+static int
+print_inventory(const char *path, int cached)
+{
+	struct icpdas_inventory inv;
+	int slot;
 
+	if (cached ? icpdas_inventory_get(path, &inv) :
+			icpdas_inventory_refresh(path, &inv))
+		return 1;
+	for (slot = 1; slot <= inv.slot_count; slot++)
+		print_module(slot, inv.model[slot][0] ? inv.model[slot] : NULL);
 	return 0;
 }
+
+int main(int argc, char *argv[])
+{
+	const char *stats_file = ICP_STATS_FILE;
+	const char *inventory_file = ICP_INVENTORY_FILE;
+	int cached = 0, stats = 0;
+	int opt;
+
+	while ((opt = getopt(argc, argv, "cf:hi:r:s")) != -1) {
+		switch (opt) {
+		case 'c':
+			cached = 1;
+			break;
+		case 'f':
+			stats_file = optarg;
+			break;
+		case 'h':
+			usage(0);
+			break;
+		case 'i':
+			inventory_file = optarg;
+			break;
+		case 'r':
+			icpdas_sysfs_set_root(optarg);
+			break;
+		case 's':
+			stats = 1;
+			break;
+		default:
+			usage(1);
+			break;
+		}
+	}
+
+	log_init("lsicpdas", LOG_NOTICE, LOG_DAEMON, 1);
+
+	if (stats)
+		return print_stats(stats_file);
+	return print_inventory(inventory_file, cached);
+}
@@ -0,0 +1,222 @@
+/* modbus-read.c -- read Modbus registers
+ * Copyright (C) 2014 Sergey Yanovich <ynvich@gmail.com>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 2 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public
+ * License along with this program; if not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+ * Boston, MA 02111-1307, USA.
+ */
+
+#include "includes.h"
+
+#include <stdio.h>
+#include <string.h>
+
+#include "block.h"
+#include "map.h"
+#include "modbus.h"
+#include "modbus-read.h"
+#include "state.h"
+
+#define PCS_BLOCK	"modbus read"
+
+/*
+ * Outputs r0, r1, ... hold count registers starting at address. Blocks
+ * on the same device share requests, see modbus_plan().
+ */
+struct modbus_read_state {
+	const char		*device;
+	long			baud;
+	int			sign;
+	struct modbus_read	read;
+};
+
+static void
+modbus_read_done(struct modbus_read *r, int err, const unsigned short *regs)
+{
+	struct block *b = r->data;
+	struct modbus_read_state *d = b->data;
+	unsigned int i;
+
+	if (0 > err) {
+		error("%s: bad modbus input, unit %u\n", b->name, r->unit);
+		return;
+	}
+	for (i = 0; i < r->count; i++)
+		b->outputs[i] = d->sign ? (short) regs[i] : regs[i];
+	debug("%s: modbus %u registers at %u, r0 %li\n", b->name, r->count,
+			r->address, b->outputs[0]);
+}
+
+static void
+modbus_read_run(struct block *b, struct server_state *s)
+{
+	struct modbus_read_state *d = b->data;
+
+	modbus_submit(&d->read);
+}
+
+static int
+set_address(void *data, const char const *key, long value)
+{
+	struct modbus_read_state *d = data;
+	d->read.address = (unsigned) value;
+	debug("address = %u\n", d->read.address);
+	return 0;
+}
+
+static int
+set_baud(void *data, const char const *key, long value)
+{
+	struct modbus_read_state *d = data;
+	d->baud = value;
+	debug("baud = %li\n", d->baud);
+	return 0;
+}
+
+static int
+set_count(void *data, const char const *key, long value)
+{
+	struct modbus_read_state *d = data;
+	d->read.count = (unsigned) value;
+	debug("count = %u\n", d->read.count);
+	return 0;
+}
+
+static int
+set_function(void *data, const char const *key, long value)
+{
+	struct modbus_read_state *d = data;
+	d->read.function = (unsigned) value;
+	debug("function = %u\n", d->read.function);
+	return 0;
+}
+
+static int
+set_signed(void *data, const char const *key, long value)
+{
+	struct modbus_read_state *d = data;
+	d->sign = !!value;
+	debug("signed = %i\n", d->sign);
+	return 0;
+}
+
+static int
+set_unit(void *data, const char const *key, long value)
+{
+	struct modbus_read_state *d = data;
+	d->read.unit = (unsigned) value;
+	debug("unit = %u\n", d->read.unit);
+	return 0;
+}
+
+static struct pcs_map setpoints[] = {
+	{
+		.key			= "address",
+		.value			= set_address,
+	}
+	,{
+		.key			= "baud",
+		.value			= set_baud,
+	}
+	,{
+		.key			= "count",
+		.value			= set_count,
+	}
+	,{
+		.key			= "function",
+		.value			= set_function,
+	}
+	,{
+		.key			= "signed",
+		.value			= set_signed,
+	}
+	,{
+		.key			= "unit",
+		.value			= set_unit,
+	}
+	,{
+	}
+};
+
+static int
+set_device(void *data, const char const *key, const char const *value)
+{
+	struct modbus_read_state *d = data;
+	d->device = strdup(value);
+	debug("device = %s\n", d->device);
+	return 0;
+}
+
+static struct pcs_map strings[] = {
+	{
+		.key			= "device",
+		.value			= set_device,
+	}
+	,{
+	}
+};
+
+static void *
+alloc(void)
+{
+	struct modbus_read_state *d = xzalloc(sizeof(*d));
+	d->baud = MODBUS_BAUD_RATE;
+	d->read.unit = 1;
+	d->read.function = MODBUS_READ_HOLDING;
+	d->read.count = 1;
+	return d;
+}
+
+static struct block_ops ops = {
+	.run		= modbus_read_run,
+};
+
+static struct block_ops *
+init(struct block *b)
+{
+	struct modbus_read_state *d = b->data;
+	unsigned int i;
+	char buff[16];
+
+	if (!d->device) {
+		error("%s: no device\n", PCS_BLOCK);
+		return NULL;
+	}
+	d->read.done = modbus_read_done;
+	d->read.data = b;
+	if (modbus_attach(d->device, d->baud, &d->read))
+		return NULL;
+
+	b->outputs_table = xzalloc(sizeof(*b->outputs_table) *
+			(d->read.count + 1));
+	for (i = 0; i < d->read.count; i++) {
+		snprintf(buff, sizeof(buff), "r%u", i);
+		b->outputs_table[i] = strdup(buff);
+	}
+	return &ops;
+}
+
+static struct block_builder builder = {
+	.alloc		= alloc,
+	.ops		= init,
+	.setpoints	= setpoints,
+	.strings	= strings,
+	.flags		= PCS_BLOCK_IO | PCS_BLOCK_INPUT,
+};
+
+struct block_builder *
+load_modbus_read_builder(void)
+{
+	return &builder;
+}
@@ -0,0 +1,293 @@
+/* modbus-sim.c -- simulate Modbus slaves on TCP or a pseudo-terminal
+ * Copyright (C) 2014 Sergey Yanovich <ynvich@gmail.com>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 2 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public
+ * License along with this program; if not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+ * Boston, MA 02111-1307, USA.
+ */
+
+#define _GNU_SOURCE
+#include "includes.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <netinet/in.h>
+#include <poll.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <termios.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "modbus.h"
+
+#define MAX_CLIENTS	8
+#define MAX_FRAME	260
+
+/*
+ * The simulator answers "read holding registers" and "read input
+ * registers" for every unit. Input register N reads N, and holding
+ * register N reads -N as a signed value, so replies are easy to check.
+ *
+ * With -p, it listens on the TCP port of the loopback interface, and
+ * prints the port. Port 0 picks a free one. With -r, it prints the name
+ * of a pseudo-terminal and answers RTU frames on it instead. A reply is
+ * sent after the module delay, plus the wire time for RTU.
+ */
+static void
+usage(int err)
+{
+	fprintf(stderr, "Usage: modbus-sim [-d] [-b baud] [-l usec] "
+			"-p port | -r\n");
+	fprintf(stderr, "       modbus-sim  -h\n");
+	exit(err);
+}
+
+static void
+pace(long usec)
+{
+	struct timespec ts = {
+		.tv_sec		= usec / 1000000,
+		.tv_nsec	= (usec % 1000000) * 1000,
+	};
+
+	while (nanosleep(&ts, &ts) && EINTR == errno)
+		;
+}
+
+/* Answers the request pdu in place, and returns the reply length */
+static int
+answer(unsigned int unit, unsigned char *pdu)
+{
+	unsigned int function = pdu[0], address, count, i, value;
+
+	address = pdu[1] << 8 | pdu[2];
+	count = pdu[3] << 8 | pdu[4];
+	debug("unit %u function %u address %u count %u\n", unit, function,
+			address, count);
+	pdu[1] = 0;
+	if (MODBUS_READ_HOLDING != function && MODBUS_READ_INPUT != function)
+		pdu[1] = 1;
+	else if (!count || count > MODBUS_MAX_REGS)
+		pdu[1] = 3;
+	else if (address + count > 0x10000)
+		pdu[1] = 2;
+	if (pdu[1]) {
+		pdu[0] |= 0x80;
+		return 2;
+	}
+
+	pdu[1] = 2 * count;
+	for (i = 0; i < count; i++) {
+		value = address + i;
+		if (MODBUS_READ_HOLDING == function)
+			value = -value;
+		pdu[2 + 2 * i] = value >> 8;
+		pdu[3 + 2 * i] = value;
+	}
+	return 2 + 2 * count;
+}
+
+struct client {
+	int			fd;
+	int			len;
+	unsigned char		rx[MAX_FRAME];
+};
+
+static int
+serve_client(struct client *c, long delay)
+{
+	unsigned char *adu = c->rx;
+	int n, len;
+
+	n = read(c->fd, &c->rx[c->len], MAX_FRAME - c->len);
+	if (0 > n && (EAGAIN == errno || EINTR == errno))
+		return 0;
+	if (0 >= n)
+		return -1;
+	c->len += n;
+	while (c->len >= 12) {
+		len = 6 + (adu[4] << 8 | adu[5]);
+		if (12 != len || adu[2] || adu[3])
+			return -1;
+		pace(delay);
+		n = answer(adu[6], &adu[7]);
+		adu[4] = (n + 1) >> 8;
+		adu[5] = n + 1;
+		if (7 + n != write(c->fd, adu, 7 + n))
+			return -1;
+		c->len -= len;
+		memmove(adu, &adu[len], c->len);
+	}
+	return 0;
+}
+
+static void
+run_tcp(unsigned int port, long delay)
+{
+	struct sockaddr_in addr = {
+		.sin_family	= AF_INET,
+		.sin_port	= htons(port),
+		.sin_addr	= { htonl(INADDR_LOOPBACK) },
+	};
+	socklen_t len = sizeof(addr);
+	struct pollfd pfd[MAX_CLIENTS + 1];
+	struct client clients[MAX_CLIENTS];
+	int fd, i, on = 1;
+
+	fd = socket(AF_INET, SOCK_STREAM, 0);
+	if (0 > fd)
+		fatal("socket: %s (%i)\n", strerror(errno), errno);
+	setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &on, sizeof(on));
+	if (bind(fd, (struct sockaddr *) &addr, sizeof(addr)) ||
+			listen(fd, MAX_CLIENTS) ||
+			getsockname(fd, (struct sockaddr *) &addr, &len))
+		fatal("port %u: %s (%i)\n", port, strerror(errno), errno);
+	printf("%u\n", ntohs(addr.sin_port));
+	fflush(stdout);
+
+	for (i = 0; i < MAX_CLIENTS; i++)
+		clients[i].fd = -1;
+	pfd[MAX_CLIENTS].fd = fd;
+	pfd[MAX_CLIENTS].events = POLLIN;
+	while (1) {
+		for (i = 0; i < MAX_CLIENTS; i++) {
+			pfd[i].fd = clients[i].fd;
+			pfd[i].events = POLLIN;
+		}
+		if (0 > poll(pfd, MAX_CLIENTS + 1, -1)) {
+			if (EINTR == errno)
+				continue;
+			fatal("poll: %s (%i)\n", strerror(errno), errno);
+		}
+		for (i = 0; i < MAX_CLIENTS; i++) {
+			if (!pfd[i].revents || !serve_client(&clients[i], delay))
+				continue;
+			debug("client %i closed\n", clients[i].fd);
+			close(clients[i].fd);
+			clients[i].fd = -1;
+		}
+		if (!pfd[MAX_CLIENTS].revents)
+			continue;
+		for (i = 0; i < MAX_CLIENTS; i++)
+			if (0 > clients[i].fd)
+				break;
+		if (i == MAX_CLIENTS) {
+			close(accept(fd, NULL, NULL));
+			continue;
+		}
+		clients[i].fd = accept(fd, NULL, NULL);
+		clients[i].len = 0;
+		debug("client %i connected\n", clients[i].fd);
+	}
+}
+
+static void
+run_rtu(long baud, long delay)
+{
+	unsigned char frame[MAX_FRAME];
+	struct termios options;
+	unsigned short crc;
+	int master, slave, len = 0, n;
+
+	master = posix_openpt(O_RDWR | O_NOCTTY);
+	if (0 > master || grantpt(master) || unlockpt(master))
+		fatal("pseudo-terminal: %s (%i)\n", strerror(errno), errno);
+
+	/* Keep the line raw and open while clients come and go */
+	slave = open(ptsname(master), O_RDWR | O_NOCTTY);
+	if (0 > slave || tcgetattr(slave, &options))
+		fatal("%s: %s (%i)\n", ptsname(master), strerror(errno),
+				errno);
+	cfmakeraw(&options);
+	tcsetattr(slave, TCSANOW, &options);
+
+	printf("%s\n", ptsname(master));
+	fflush(stdout);
+
+	while (1) {
+		n = read(master, &frame[len], MAX_FRAME - len);
+		if (0 > n && EINTR == errno)
+			continue;
+		if (0 >= n)
+			fatal("%s: %s (%i)\n", ptsname(master),
+					strerror(errno), errno);
+		len += n;
+		if (len < 8)
+			continue;
+		crc = modbus_crc16(frame, 6);
+		if (frame[6] != (crc & 0xff) || frame[7] != crc >> 8) {
+			debug("bad request CRC\n");
+			len = 0;
+			continue;
+		}
+		n = 1 + answer(frame[0], &frame[1]);
+		crc = modbus_crc16(frame, n);
+		frame[n++] = crc;
+		frame[n++] = crc >> 8;
+		pace(delay + (8 + n) * 10 * 1000000L / baud);
+		if (n != write(master, frame, n))
+			error("%s: %s (%i)\n", ptsname(master),
+					strerror(errno), errno);
+		len = 0;
+	}
+}
+
+int
+main(int argc, char **argv)
+{
+	int log_level = LOG_NOTICE;
+	long baud = MODBUS_BAUD_RATE, delay = 0, port = -1;
+	int opt, rtu = 0;
+
+	while ((opt = getopt(argc, argv, "b:dhl:p:r")) != -1) {
+		switch (opt) {
+		case 'b':
+			baud = strtol(optarg, NULL, 10);
+			break;
+		case 'd':
+			if (log_level >= LOG_DEBUG)
+				log_level++;
+			else
+				log_level = LOG_DEBUG;
+			break;
+		case 'h':
+			usage(0);
+			break;
+		case 'l':
+			delay = strtol(optarg, NULL, 10);
+			break;
+		case 'p':
+			port = strtol(optarg, NULL, 10);
+			break;
+		case 'r':
+			rtu = 1;
+			break;
+		default:
+			usage(1);
+			break;
+		}
+	}
+	if (optind != argc || rtu == (0 <= port) || 0 >= baud ||
+			port > 65535)
+		usage(1);
+
+	log_init("modbus-sim", log_level, LOG_DAEMON, 1);
+	if (rtu)
+		run_rtu(baud, delay);
+	else
+		run_tcp(port, delay);
+	return 0;
+}
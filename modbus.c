@@ -0,0 +1,717 @@
+/* modbus.c -- Modbus RTU and TCP input
+ * Copyright (C) 2014 Sergey Yanovich <ynvich@gmail.com>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 2 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public
+ * License along with this program; if not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+ * Boston, MA 02111-1307, USA.
+ */
+
+#define _GNU_SOURCE
+#include "includes.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <netdb.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <poll.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <termios.h>
+#include <unistd.h>
+
+#include "modbus.h"
+#include "pcs-clock.h"
+
+#define MODBUS_RX_SIZE		512
+/* A slave must start its reply within this time */
+#define MODBUS_TURNAROUND_USEC	50000
+#define MODBUS_CONNECT_USEC	200000
+/* Requests a TCP link keeps in flight */
+#define MODBUS_TCP_WINDOW	16
+
+/*
+ * modbus_plan() sorts the reads of a link by unit, function and address,
+ * and merges reads which touch or overlap into frames of up to
+ * MODBUS_MAX_REGS registers. A frame is a single request on the wire,
+ * and its reply completes every read it covers.
+ */
+struct modbus_frame {
+	struct modbus_link	*link;
+	unsigned int		unit;
+	unsigned int		function;
+	unsigned int		address;
+	unsigned int		count;
+	struct modbus_read	**reads;
+	unsigned int		nreads;
+	unsigned long		generation;
+	int			wanted;
+	int			err;
+	unsigned short		tid;
+	unsigned short		regs[MODBUS_MAX_REGS];
+};
+
+/*
+ * A link is a serial line with RTU framing, or a TCP connection to a
+ * host. RTU requests go one at a time. TCP requests are pipelined up to
+ * MODBUS_TCP_WINDOW, and replies are matched by transaction id. The
+ * port or the connection is reopened after an error.
+ */
+struct modbus_link {
+	struct modbus_link	*next;
+	char			*device;
+	char			*host;
+	const char		*service;
+	long			baud;
+	int			fd;
+	pthread_mutex_t		lock;
+	struct modbus_read	*attached;
+	unsigned int		nattached;
+	struct modbus_read	**reads;
+	struct modbus_frame	*frames;
+	unsigned int		nframes;
+	struct modbus_frame	**queue;
+	unsigned short		tid;
+	int			rx_len;
+	unsigned char		rx[MODBUS_RX_SIZE];
+};
+
+static struct modbus_link *modbus_links;
+static int modbus_batching;
+static unsigned long modbus_generation = 1;
+
+unsigned short
+modbus_crc16(const unsigned char *data, int len)
+{
+	unsigned short crc = 0xffff;
+	int i;
+
+	while (len--) {
+		crc ^= *data++;
+		for (i = 0; i < 8; i++)
+			crc = (crc & 1) ? (crc >> 1) ^ 0xa001 : crc >> 1;
+	}
+	return crc;
+}
+
+/*
+ * A device which starts with a slash is a serial port. Anything else is
+ * a host with an optional port after a colon.
+ */
+int
+modbus_attach(const char *device, long baud, struct modbus_read *r)
+{
+	struct modbus_link *l;
+	char *colon;
+
+	if (!r->count || r->count > MODBUS_MAX_REGS ||
+			r->address + r->count > 0x10000 || r->unit > 247 ||
+			(MODBUS_READ_HOLDING != r->function &&
+			 MODBUS_READ_INPUT != r->function)) {
+		error("%s: bad read of %u registers at %u, unit %u, "
+				"function %u\n", device, r->count, r->address,
+				r->unit, r->function);
+		return -1;
+	}
+
+	for (l = modbus_links; l; l = l->next)
+		if (!strcmp(l->device, device))
+			break;
+	if (!l) {
+		l = xzalloc(sizeof(*l));
+		l->device = strdup(device);
+		l->fd = -1;
+		l->baud = baud;
+		pthread_mutex_init(&l->lock, NULL);
+		if ('/' != device[0]) {
+			l->host = strdup(device);
+			colon = strrchr(l->host, ':');
+			if (colon) {
+				*colon = 0;
+				l->service = colon + 1;
+			} else {
+				l->service = MODBUS_TCP_PORT;
+			}
+		}
+		l->next = modbus_links;
+		modbus_links = l;
+	}
+	if (!l->host && l->baud != baud) {
+		error("%s: baud rate %li conflicts with %li\n", device,
+				baud, l->baud);
+		return -1;
+	}
+
+	r->next = l->attached;
+	l->attached = r;
+	l->nattached++;
+	return 0;
+}
+
+static int
+modbus_cmp_read(const void *a, const void *b)
+{
+	const struct modbus_read *x = *(struct modbus_read * const *) a;
+	const struct modbus_read *y = *(struct modbus_read * const *) b;
+
+	if (x->unit != y->unit)
+		return x->unit < y->unit ? -1 : 1;
+	if (x->function != y->function)
+		return x->function < y->function ? -1 : 1;
+	if (x->address != y->address)
+		return x->address < y->address ? -1 : 1;
+	return x->count > y->count ? -1 : x->count < y->count;
+}
+
+static void
+modbus_link_plan(struct modbus_link *l)
+{
+	struct modbus_frame *f = NULL;
+	struct modbus_read *r;
+	unsigned int i = 0, end;
+
+	l->reads = xcalloc(l->nattached, sizeof(*l->reads));
+	for (r = l->attached; r; r = r->next)
+		l->reads[i++] = r;
+	qsort(l->reads, l->nattached, sizeof(*l->reads), modbus_cmp_read);
+
+	l->frames = xcalloc(l->nattached, sizeof(*l->frames));
+	l->queue = xcalloc(l->nattached, sizeof(*l->queue));
+	for (i = 0; i < l->nattached; i++) {
+		r = l->reads[i];
+		end = r->address + r->count;
+		if (f && f->unit == r->unit && f->function == r->function &&
+				r->address <= f->address + f->count &&
+				end <= f->address + MODBUS_MAX_REGS) {
+			if (end > f->address + f->count)
+				f->count = end - f->address;
+			f->nreads++;
+			r->frame = f;
+			continue;
+		}
+		f = &l->frames[l->nframes++];
+		f->link = l;
+		f->unit = r->unit;
+		f->function = r->function;
+		f->address = r->address;
+		f->count = r->count;
+		f->reads = &l->reads[i];
+		f->nreads = 1;
+		r->frame = f;
+	}
+
+	for (i = 0; i < l->nframes; i++) {
+		f = &l->frames[i];
+		debug("%s: unit %u function %u reads %u registers at %u "
+				"for %u blocks\n", l->device, f->unit,
+				f->function, f->count, f->address, f->nreads);
+	}
+}
+
+/* Returns the number of frames every tick needs */
+int
+modbus_plan(void)
+{
+	struct modbus_link *l;
+	int frames = 0;
+
+	for (l = modbus_links; l; l = l->next) {
+		if (!l->frames)
+			modbus_link_plan(l);
+		frames += l->nframes;
+	}
+	return frames;
+}
+
+static void
+modbus_link_reset(struct modbus_link *l)
+{
+	if (0 > l->fd)
+		return;
+	close(l->fd);
+	l->fd = -1;
+	l->rx_len = 0;
+}
+
+static speed_t
+modbus_speed(long baud)
+{
+	switch (baud) {
+	case 1200:	return B1200;
+	case 2400:	return B2400;
+	case 4800:	return B4800;
+	case 9600:	return B9600;
+	case 19200:	return B19200;
+	case 38400:	return B38400;
+	case 57600:	return B57600;
+	case 115200:	return B115200;
+	default:	return B0;
+	}
+}
+
+static int
+modbus_rtu_open(struct modbus_link *l)
+{
+	struct termios options;
+	speed_t speed = modbus_speed(l->baud);
+	int fd;
+
+	if (B0 == speed) {
+		error("%s: unsupported baud rate %li\n", l->device, l->baud);
+		return -1;
+	}
+	fd = open(l->device, O_RDWR | O_NOCTTY | O_NONBLOCK);
+	if (-1 == fd) {
+		error("%s: %s (%i) when openning port\n",
+				l->device, strerror(errno), errno);
+		return -1;
+	}
+	if (tcgetattr(fd, &options)) {
+		error("%s: %s (%i) when getting termios data\n",
+				l->device, strerror(errno), errno);
+		goto close_fd;
+	}
+
+	/* 8N1, no flow control */
+	cfmakeraw(&options);
+	cfsetispeed(&options, speed);
+	cfsetospeed(&options, speed);
+	options.c_cflag &= ~(PARENB | PARODD | CSTOPB | CRTSCTS);
+	options.c_cflag |= CLOCAL | CREAD;
+	options.c_iflag &= ~(IXON | IXOFF);
+	options.c_cc[VTIME] = 0;
+	options.c_cc[VMIN] = 0;
+
+	if (tcsetattr(fd, TCSAFLUSH, &options)) {
+		error("%s: %s (%i) when setting termios data\n",
+				l->device, strerror(errno), errno);
+		goto close_fd;
+	}
+
+	l->fd = fd;
+	return 0;
+
+close_fd:
+	close(fd);
+	return -1;
+}
+
+static int
+modbus_wait(struct modbus_link *l, short events,
+		const struct timespec *deadline)
+{
+	struct pollfd pfd = {
+		.fd		= l->fd,
+		.events		= events,
+	};
+	struct timespec now, left;
+	long usec;
+	int err;
+
+	while (1) {
+		pcs_clock_now(&now);
+		usec = pcs_clock_diff(deadline, &now);
+		if (0 >= usec) {
+			debug("%s: timeout\n", l->device);
+			return -1;
+		}
+		left.tv_sec = usec / 1000000;
+		left.tv_nsec = (usec % 1000000) * 1000;
+		err = ppoll(&pfd, 1, &left, NULL);
+		if (0 < err)
+			return 0;
+		if (0 > err && EINTR != errno) {
+			error("%s: %s (%i) when waiting\n", l->device,
+					strerror(errno), errno);
+			return -1;
+		}
+	}
+}
+
+/* Reads until rx holds at least want bytes */
+static int
+modbus_read_bytes(struct modbus_link *l, int want,
+		const struct timespec *deadline)
+{
+	int err;
+
+	if (want > MODBUS_RX_SIZE) {
+		error("%s: reply is too long (%i)\n", l->device, want);
+		return -1;
+	}
+	while (l->rx_len < want) {
+		if (modbus_wait(l, POLLIN, deadline))
+			return -1;
+		err = read(l->fd, &l->rx[l->rx_len],
+				MODBUS_RX_SIZE - l->rx_len);
+		if (0 == err) {
+			error("%s: connection closed\n", l->device);
+			return -1;
+		}
+		if (0 > err && EAGAIN != errno && EINTR != errno) {
+			error("%s: %s (%i) when reading reply\n",
+					l->device, strerror(errno), errno);
+			return -1;
+		}
+		if (0 < err)
+			l->rx_len += err;
+	}
+	return 0;
+}
+
+static void
+modbus_consume(struct modbus_link *l, int len)
+{
+	l->rx_len -= len;
+	memmove(l->rx, &l->rx[len], l->rx_len);
+}
+
+static int
+modbus_encode_pdu(const struct modbus_frame *f, unsigned char *pdu)
+{
+	pdu[0] = f->function;
+	pdu[1] = f->address >> 8;
+	pdu[2] = f->address;
+	pdu[3] = f->count >> 8;
+	pdu[4] = f->count;
+	return 5;
+}
+
+static int
+modbus_parse_pdu(struct modbus_frame *f, const unsigned char *pdu, int len)
+{
+	const char *device = f->link->device;
+	unsigned int i;
+
+	if (2 <= len && (f->function | 0x80) == pdu[0]) {
+		error("%s: unit %u exception %u reading %u registers at %u\n",
+				device, f->unit, pdu[1], f->count, f->address);
+		return -1;
+	}
+	if (2 + 2 * f->count != len || f->function != pdu[0] ||
+			2 * f->count != pdu[1]) {
+		error("%s: unit %u bad reply reading %u registers at %u\n",
+				device, f->unit, f->count, f->address);
+		return -1;
+	}
+	for (i = 0; i < f->count; i++)
+		f->regs[i] = pdu[2 + 2 * i] << 8 | pdu[3 + 2 * i];
+	return 0;
+}
+
+static long
+modbus_wire_usec(struct modbus_link *l, int chars)
+{
+	/* The standard counts 11 bits a character, a margin for 8N1 */
+	return chars * 11 * 1000000L / l->baud;
+}
+
+static void
+modbus_deadline(struct timespec *ts, long usec)
+{
+	struct timeval tv = {
+		.tv_sec		= usec / 1000000,
+		.tv_usec	= usec % 1000000,
+	};
+
+	pcs_clock_now(ts);
+	pcs_clock_add(ts, &tv);
+}
+
+/*
+ * Sends a request and reads the reply, which is 5 bytes for an exception
+ * and 5 plus the byte count otherwise. The line then stays silent for at
+ * least 3.5 characters, which ends the frame for the other slaves.
+ */
+static int
+modbus_rtu_transfer(struct modbus_link *l, struct modbus_frame *f)
+{
+	struct timespec deadline, quiet;
+	unsigned char tx[8];
+	unsigned short crc;
+	int len, want;
+
+	if (0 > l->fd && modbus_rtu_open(l))
+		return -1;
+
+	tx[0] = f->unit;
+	len = 1 + modbus_encode_pdu(f, &tx[1]);
+	crc = modbus_crc16(tx, len);
+	tx[len++] = crc;
+	tx[len++] = crc >> 8;
+
+	tcflush(l->fd, TCIFLUSH);
+	l->rx_len = 0;
+	if (len != write(l->fd, tx, len)) {
+		error("%s: %s (%i) when sending request\n", l->device,
+				strerror(errno), errno);
+		goto reset;
+	}
+	want = 5 + 2 * f->count;
+	modbus_deadline(&deadline, modbus_wire_usec(l, len + want) +
+			MODBUS_TURNAROUND_USEC);
+	if (modbus_read_bytes(l, 3, &deadline))
+		return -1;
+	if (l->rx[1] & 0x80)
+		want = 5;
+	else
+		want = 5 + l->rx[2];
+	if (modbus_read_bytes(l, want, &deadline))
+		return -1;
+
+	modbus_deadline(&quiet, modbus_wire_usec(l, 4));
+	while (EINTR == clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME,
+				&quiet, NULL))
+		;
+
+	crc = modbus_crc16(l->rx, want - 2);
+	if (l->rx[want - 2] != (crc & 0xff) || l->rx[want - 1] != crc >> 8) {
+		error("%s: unit %u bad CRC\n", l->device, f->unit);
+		return -1;
+	}
+	if (l->rx[0] != f->unit) {
+		error("%s: unit %u replied for unit %u\n", l->device,
+				l->rx[0], f->unit);
+		return -1;
+	}
+	return modbus_parse_pdu(f, &l->rx[1], want - 3);
+
+reset:
+	modbus_link_reset(l);
+	return -1;
+}
+
+static int
+modbus_tcp_connect(struct modbus_link *l)
+{
+	struct addrinfo hints, *res, *ai;
+	struct timespec deadline;
+	socklen_t len = sizeof(int);
+	int fd = -1, err, on = 1;
+
+	memset(&hints, 0, sizeof(hints));
+	hints.ai_family = AF_UNSPEC;
+	hints.ai_socktype = SOCK_STREAM;
+	err = getaddrinfo(l->host, l->service, &hints, &res);
+	if (err) {
+		error("%s: %s\n", l->device, gai_strerror(err));
+		return -1;
+	}
+
+	for (ai = res; ai; ai = ai->ai_next) {
+		fd = socket(ai->ai_family, ai->ai_socktype | SOCK_NONBLOCK,
+				ai->ai_protocol);
+		if (0 > fd)
+			continue;
+		l->fd = fd;
+		modbus_deadline(&deadline, MODBUS_CONNECT_USEC);
+		if (!connect(fd, ai->ai_addr, ai->ai_addrlen))
+			break;
+		if (EINPROGRESS == errno &&
+				!modbus_wait(l, POLLOUT, &deadline) &&
+				!getsockopt(fd, SOL_SOCKET, SO_ERROR, &err, &len)
+				&& !err)
+			break;
+		close(fd);
+		l->fd = fd = -1;
+	}
+	freeaddrinfo(res);
+	if (0 > fd) {
+		error("%s: failed to connect\n", l->device);
+		return -1;
+	}
+	setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &on, sizeof(on));
+	l->rx_len = 0;
+	debug("%s: connected\n", l->device);
+	return 0;
+}
+
+/* Reads one reply, and returns its length */
+static int
+modbus_tcp_read(struct modbus_link *l, const struct timespec *deadline)
+{
+	int len;
+
+	if (modbus_read_bytes(l, 7, deadline))
+		return -1;
+	len = 6 + (l->rx[4] << 8 | l->rx[5]);
+	if (8 > len || l->rx[2] || l->rx[3]) {
+		error("%s: bad reply header\n", l->device);
+		return -1;
+	}
+	if (modbus_read_bytes(l, len, deadline))
+		return -1;
+	return len;
+}
+
+/*
+ * Keeps up to MODBUS_TCP_WINDOW requests in flight. queue[done, sent)
+ * holds the frames waiting for replies, and a reply moves its frame to
+ * the front of that range. Frames which were not answered fail.
+ */
+static void
+modbus_tcp_run(struct modbus_link *l, struct modbus_frame **queue,
+		unsigned int n)
+{
+	unsigned char tx[MODBUS_TCP_WINDOW * 12];
+	unsigned int sent = 0, done = 0, i;
+	struct timespec deadline;
+	struct modbus_frame *f;
+	unsigned short tid;
+	int len;
+
+	if (0 > l->fd && modbus_tcp_connect(l))
+		goto fail;
+
+	while (done < n) {
+		len = 0;
+		while (sent < n && sent - done < MODBUS_TCP_WINDOW) {
+			f = queue[sent++];
+			f->tid = l->tid++;
+			tx[len + 0] = f->tid >> 8;
+			tx[len + 1] = f->tid;
+			tx[len + 2] = 0;
+			tx[len + 3] = 0;
+			tx[len + 4] = 0;
+			tx[len + 5] = 6;
+			tx[len + 6] = f->unit;
+			len += 7 + modbus_encode_pdu(f, &tx[len + 7]);
+		}
+		if (len && len != write(l->fd, tx, len)) {
+			error("%s: %s (%i) when sending requests\n",
+					l->device, strerror(errno), errno);
+			goto fail;
+		}
+
+		modbus_deadline(&deadline, MODBUS_TURNAROUND_USEC);
+		len = modbus_tcp_read(l, &deadline);
+		if (0 > len)
+			goto fail;
+		tid = l->rx[0] << 8 | l->rx[1];
+		for (i = done; i < sent; i++)
+			if (queue[i]->tid == tid)
+				break;
+		if (i == sent) {
+			debug("%s: stray reply %u\n", l->device, tid);
+			modbus_consume(l, len);
+			continue;
+		}
+		f = queue[i];
+		queue[i] = queue[done];
+		queue[done++] = f;
+		f->err = l->rx[6] == f->unit ?
+			modbus_parse_pdu(f, &l->rx[7], len - 7) : -1;
+		modbus_consume(l, len);
+	}
+	return;
+
+fail:
+	modbus_link_reset(l);
+	for (i = done; i < n; i++)
+		queue[i]->err = -1;
+}
+
+static void
+modbus_link_run(struct modbus_link *l, struct modbus_frame **queue,
+		unsigned int n)
+{
+	unsigned int i;
+
+	if (l->host) {
+		modbus_tcp_run(l, queue, n);
+	} else {
+		for (i = 0; i < n; i++)
+			queue[i]->err = modbus_rtu_transfer(l, queue[i]);
+	}
+	for (i = 0; i < n; i++)
+		queue[i]->generation = modbus_generation;
+}
+
+/* Completes the pending reads of a frame. The caller holds the lock */
+static void
+modbus_complete(struct modbus_frame *f)
+{
+	struct modbus_read *r;
+	unsigned int i;
+
+	for (i = 0; i < f->nreads; i++) {
+		r = f->reads[i];
+		if (!r->pending)
+			continue;
+		r->pending = 0;
+		r->done(r, f->err, f->err ? NULL :
+				&f->regs[r->address - f->address]);
+	}
+}
+
+/*
+ * In batch mode, reads are only marked here, and modbus_flush() reads
+ * their frames. Otherwise, the frame is read at once, unless another
+ * read has already fetched it this tick.
+ */
+void
+modbus_batch(int on)
+{
+	modbus_batching = on;
+}
+
+/* Starts a new tick. Frames read earlier are stale from now on */
+void
+modbus_sync(void)
+{
+	modbus_generation++;
+}
+
+void
+modbus_submit(struct modbus_read *r)
+{
+	struct modbus_frame *f = r->frame;
+	struct modbus_link *l = f->link;
+
+	pthread_mutex_lock(&l->lock);
+	r->pending = 1;
+	if (modbus_batching) {
+		f->wanted = 1;
+	} else {
+		if (f->generation != modbus_generation)
+			modbus_link_run(l, &f, 1);
+		modbus_complete(f);
+	}
+	pthread_mutex_unlock(&l->lock);
+}
+
+void
+modbus_flush(void)
+{
+	struct modbus_link *l;
+	unsigned int i, n;
+
+	for (l = modbus_links; l; l = l->next) {
+		pthread_mutex_lock(&l->lock);
+		n = 0;
+		for (i = 0; i < l->nframes; i++) {
+			if (!l->frames[i].wanted)
+				continue;
+			l->frames[i].wanted = 0;
+			l->queue[n++] = &l->frames[i];
+		}
+		if (n)
+			modbus_link_run(l, l->queue, n);
+		for (i = 0; i < n; i++)
+			modbus_complete(l->queue[i]);
+		pthread_mutex_unlock(&l->lock);
+	}
+}
@@ -0,0 +1,65 @@
+/* modbus.h -- Modbus RTU and TCP input
+ * Copyright (C) 2014 Sergey Yanovich <ynvich@gmail.com>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 2 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public
+ * License along with this program; if not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+ * Boston, MA 02111-1307, USA.
+ */
+
+#ifndef _PCS_MODBUS_H
+#define _PCS_MODBUS_H
+
+#define MODBUS_READ_HOLDING	3
+#define MODBUS_READ_INPUT	4
+/* The most registers a single read request may ask for */
+#define MODBUS_MAX_REGS		125
+#define MODBUS_TCP_PORT		"502"
+#define MODBUS_BAUD_RATE	19200
+
+struct modbus_frame;
+
+/*
+ * A range of registers a block reads every time it runs. The caller
+ * fills in everything above frame, then attaches the read to a device
+ * before modbus_plan(). regs is NULL after an error, and holds count
+ * registers otherwise.
+ */
+struct modbus_read {
+	struct modbus_read	*next;
+	unsigned int		unit;
+	unsigned int		function;
+	unsigned int		address;
+	unsigned int		count;
+	void			(*done)(struct modbus_read *r, int err,
+					const unsigned short *regs);
+	void			*data;
+	struct modbus_frame	*frame;
+	int			pending;
+};
+
+unsigned short
+modbus_crc16(const unsigned char *data, int len);
+int
+modbus_attach(const char *device, long baud, struct modbus_read *r);
+int
+modbus_plan(void);
+void
+modbus_batch(int on);
+void
+modbus_sync(void);
+void
+modbus_submit(struct modbus_read *r);
+void
+modbus_flush(void);
+#endif /* _PCS_MODBUS_H */
@@ -0,0 +1,250 @@
+/* parallel.c -- run independent blocks on several threads
+ * Copyright (C) 2014 Sergei Ianovich <ynvich@gmail.com>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 2 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public
+ * License along with this program; if not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+ * Boston, MA 02111-1307, USA.
+ */
+
+#include "includes.h"
+
+#include <pthread.h>
+#include <signal.h>
+#include <string.h>
+
+#include "block.h"
+#include "block_builder.h"
+#include "list.h"
+#include "parallel.h"
+#include "profile.h"
+#include "state.h"
+
+struct parallel_pool {
+	unsigned int		threads;
+	pthread_t		*tids;
+	pthread_barrier_t	barrier;
+	unsigned int		levels_count;
+	unsigned int		*fill;
+	unsigned int		*level_start;
+	unsigned int		*level_end;
+	unsigned int		*cursor;
+	unsigned int		plan_levels;
+	struct block		**plan;
+	struct server_state	*s;
+	int			quit;
+};
+
+static int
+block_io(struct block *b)
+{
+	return b->builder && (b->builder->flags & PCS_BLOCK_IO);
+}
+
+static int
+block_writes_inputs(struct block *b)
+{
+	return b->builder && (b->builder->flags & PCS_BLOCK_WRITES_INPUTS);
+}
+
+/*
+ * A block has to run after
+ *  - earlier blocks it reads from;
+ *  - earlier blocks which read from it, so they see the old value;
+ *  - the previous block doing I/O, so side effects keep their order;
+ *  - the last block writing to its inputs, which itself runs after
+ *    all blocks before it.
+ * The level of a block is the length of the longest such chain before it.
+ * Blocks of the same level never touch each other's outputs. Inputs
+ * from blocks outside the list, such as the I/O stage, are published
+ * before the tick and do not order anything. Their indices belong to
+ * another list.
+ */
+static unsigned int
+assign_levels(struct list_head *block_list, unsigned int count)
+{
+	unsigned int *after = xcalloc(count + 1, sizeof(*after));
+	struct block **member = xcalloc(count + 1, sizeof(*member));
+	unsigned int levels = 1, barrier = 0;
+	struct block *b, *d, *io = NULL;
+	unsigned int i, level;
+
+	list_for_each_entry(b, block_list, block_entry)
+		if (b->index < count)
+			member[b->index] = b;
+
+	list_for_each_entry(b, block_list, block_entry) {
+		level = after[b->index];
+		if (barrier > level)
+			level = barrier;
+		if (block_writes_inputs(b) && levels > level)
+			level = levels;
+		if (block_io(b) && io && io->level + 1 > level)
+			level = io->level + 1;
+		for (i = 0; i < b->deps_count; i++) {
+			d = b->deps[i];
+			if (d->index >= count || member[d->index] != d)
+				continue;
+			if (d->index < b->index && d->level + 1 > level)
+				level = d->level + 1;
+		}
+		b->level = level;
+		if (block_io(b))
+			io = b;
+		if (block_writes_inputs(b))
+			barrier = level + 1;
+		for (i = 0; i < b->deps_count; i++) {
+			d = b->deps[i];
+			if (d->index >= count || member[d->index] != d)
+				continue;
+			if (d->index > b->index && after[d->index] < level + 1)
+				after[d->index] = level + 1;
+		}
+		if (level + 1 > levels)
+			levels = level + 1;
+		debug3("%s: level %u\n", b->name, level);
+	}
+
+	xfree(member);
+	xfree(after);
+	return levels;
+}
+
+static void
+run_levels(struct parallel_pool *pool)
+{
+	unsigned int levels = pool->plan_levels;
+	struct block *b;
+	unsigned int l, k;
+
+	/* pool->plan_levels may change as soon as the last barrier opens */
+	for (l = 0; l < levels; l++) {
+		while (1) {
+			k = __sync_fetch_and_add(&pool->cursor[l], 1);
+			k += pool->level_start[l];
+			if (k >= pool->level_end[l])
+				break;
+			b = pool->plan[k];
+			profile_run(b, pool->s);
+		}
+		pthread_barrier_wait(&pool->barrier);
+	}
+}
+
+static void *
+worker(void *data)
+{
+	struct parallel_pool *pool = data;
+	sigset_t set;
+
+	sigfillset(&set);
+	pthread_sigmask(SIG_BLOCK, &set, NULL);
+
+	while (1) {
+		pthread_barrier_wait(&pool->barrier);
+		if (pool->quit)
+			break;
+		run_levels(pool);
+	}
+	return NULL;
+}
+
+struct parallel_pool *
+parallel_init(struct list_head *block_list, unsigned int threads)
+{
+	struct parallel_pool *pool;
+	struct block *b;
+	unsigned int count = 0, i;
+	int err;
+
+	if (threads <= 1)
+		return NULL;
+
+	list_for_each_entry(b, block_list, block_entry)
+		count++;
+
+	pool = xzalloc(sizeof(*pool));
+	pool->threads = threads;
+	pool->levels_count = assign_levels(block_list, count);
+	pool->fill = xcalloc(pool->levels_count, sizeof(*pool->fill));
+	pool->level_start = xcalloc(pool->levels_count,
+			sizeof(*pool->level_start));
+	pool->level_end = xcalloc(pool->levels_count,
+			sizeof(*pool->level_end));
+	pool->cursor = xcalloc(pool->levels_count, sizeof(*pool->cursor));
+	pool->plan = xcalloc(count + 1, sizeof(*pool->plan));
+	debug("%u blocks in %u levels on %u threads\n", count,
+			pool->levels_count, threads);
+
+	err = pthread_barrier_init(&pool->barrier, NULL, threads);
+	if (err)
+		fatal("pthread_barrier_init: %s\n", strerror(err));
+	pool->tids = xcalloc(threads, sizeof(*pool->tids));
+	for (i = 1; i < threads; i++) {
+		err = pthread_create(&pool->tids[i], NULL, worker, pool);
+		if (err)
+			fatal("pthread_create: %s\n", strerror(err));
+	}
+	return pool;
+}
+
+/*
+ * Runs @n blocks from @run, which must be in block_list order. Blocks
+ * are sorted into their levels, and each level is shared by all threads.
+ */
+void
+parallel_run(struct parallel_pool *pool, struct block **run, unsigned int n,
+		struct server_state *s)
+{
+	unsigned int i, l, pos = 0;
+
+	memset(pool->fill, 0, pool->levels_count * sizeof(*pool->fill));
+	for (i = 0; i < n; i++)
+		pool->fill[run[i]->level]++;
+
+	pool->plan_levels = 0;
+	for (l = 0; l < pool->levels_count; l++) {
+		if (!pool->fill[l])
+			continue;
+		pool->level_start[pool->plan_levels] = pos;
+		pos += pool->fill[l];
+		pool->fill[l] = pool->plan_levels++;
+	}
+	for (l = 0; l < pool->plan_levels; l++) {
+		pool->level_end[l] = pool->level_start[l];
+		pool->cursor[l] = 0;
+	}
+	for (i = 0; i < n; i++) {
+		l = pool->fill[run[i]->level];
+		pool->plan[pool->level_end[l]++] = run[i];
+	}
+
+	pool->s = s;
+	pthread_barrier_wait(&pool->barrier);
+	run_levels(pool);
+}
+
+void
+parallel_stop(struct parallel_pool *pool)
+{
+	unsigned int i;
+
+	if (!pool)
+		return;
+
+	pool->quit = 1;
+	pthread_barrier_wait(&pool->barrier);
+	for (i = 1; i < pool->threads; i++)
+		pthread_join(pool->tids[i], NULL);
+	pthread_barrier_destroy(&pool->barrier);
+}
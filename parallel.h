@@ -0,0 +1,38 @@
+/* parallel.h -- run independent blocks on several threads
+ * Copyright (C) 2014 Sergei Ianovich <ynvich@gmail.com>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 2 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public
+ * License along with this program; if not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+ * Boston, MA 02111-1307, USA.
+ */   
+
+#ifndef _PCS_PARALLEL_H
+#define _PCS_PARALLEL_H
+
+#include "block.h"
+#include "list.h"
+#include "state.h"
+
+struct parallel_pool;
+
+struct parallel_pool *
+parallel_init(struct list_head *block_list, unsigned int threads);
+
+void
+parallel_run(struct parallel_pool *pool, struct block **run, unsigned int n,
+		struct server_state *s);
+
+void
+parallel_stop(struct parallel_pool *pool);
+#endif
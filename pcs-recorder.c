@@ -0,0 +1,173 @@
+/* pcs-recorder.c -- decode the flight recorder ring
+ * Copyright (C) 2014 Sergei Ianovich <ynvich@gmail.com>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 2 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public
+ * License along with this program; if not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+ * Boston, MA 02111-1307, USA.
+ */
+
+#include "includes.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "block.h"
+#include "list.h"
+#include "recorder.h"
+#include "serverconf.h"
+
+static void
+usage(int err)
+{
+	fprintf(stderr, "Usage: pcs-recorder [-d] [-f config] file\n");
+	fprintf(stderr, "       pcs-recorder  -h\n");
+	exit(err);
+}
+
+static void
+set_name(char **names, unsigned int count, unsigned int reg,
+		const char *block, const char *output)
+{
+	size_t len = strlen(block) + (output ? strlen(output) + 1 : 0) + 1;
+
+	if (reg >= count)
+		return;
+	names[reg] = xmalloc(len);
+	if (output)
+		snprintf(names[reg], len, "%s.%s", block, output);
+	else
+		snprintf(names[reg], len, "%s", block);
+}
+
+/* Names registers the same way block inputs refer to them */
+static void
+load_names(const char *filename, char **names, unsigned int count)
+{
+	struct server_config c = {
+		.multiple	= 1,
+	};
+	struct block *b;
+	unsigned int reg;
+	int i;
+
+	INIT_LIST_HEAD(&c.block_list);
+	if (load_server_config(filename, &c))
+		fatal("Bad configuration\n");
+
+	list_for_each_entry(b, &c.block_list, block_entry) {
+		if (!b->outputs_table || !b->outputs || !b->name[0])
+			continue;
+		reg = b->outputs - c.regs;
+		if (NULL == b->outputs_table[0]) {
+			set_name(names, count, reg, b->name, NULL);
+			continue;
+		}
+		for (i = 0; b->outputs_table[i]; i++)
+			set_name(names, count, reg + i, b->name,
+					b->outputs_table[i]);
+	}
+}
+
+int
+main(int argc, char **argv)
+{
+	const char *config_file_name = NULL;
+	int log_level = LOG_NOTICE;
+	struct recorder_header *header;
+	struct recorder_record *rec;
+	struct stat st;
+	char **names;
+	size_t record_size;
+	uint64_t first, i;
+	unsigned int j;
+	int opt, fd;
+	void *map;
+
+	while ((opt = getopt(argc, argv, "df:h")) != -1) {
+		switch (opt) {
+		case 'd':
+			if (log_level >= LOG_DEBUG)
+				log_level++;
+			else
+				log_level = LOG_DEBUG;
+			break;
+		case 'f':
+			config_file_name = optarg;
+			break;
+		case 'h':
+			usage(0);
+			break;
+		default:
+			usage(1);
+			break;
+		}
+	}
+	if (optind != argc - 1)
+		usage(1);
+
+	log_init("pcs-recorder", log_level, LOG_DAEMON, 1);
+
+	fd = open(argv[optind], O_RDONLY);
+	if (0 > fd || fstat(fd, &st))
+		fatal("failed to open %s: %s\n", argv[optind],
+				strerror(errno));
+	if (st.st_size < sizeof(*header))
+		fatal("%s is too short\n", argv[optind]);
+	map = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+	if (MAP_FAILED == map)
+		fatal("failed to map %s: %s\n", argv[optind],
+				strerror(errno));
+	close(fd);
+
+	header = map;
+	if (memcmp(header->magic, PCS_RECORDER_MAGIC, sizeof(header->magic)))
+		fatal("%s is not a flight recorder file\n", argv[optind]);
+	record_size = recorder_record_size(header->regs_count);
+	if (!header->depth || st.st_size < sizeof(*header) +
+			record_size * header->depth)
+		fatal("%s is truncated\n", argv[optind]);
+
+	names = xcalloc(header->regs_count + 1, sizeof(*names));
+	if (config_file_name)
+		load_names(config_file_name, names, header->regs_count);
+
+	printf("time");
+	for (j = 0; j < header->regs_count; j++) {
+		if (names[j])
+			printf(",%s", names[j]);
+		else if (!config_file_name)
+			printf(",r%u", j);
+	}
+	printf("\n");
+
+	first = header->head > header->depth ?
+		header->head - header->depth : 0;
+	for (i = first; i < header->head; i++) {
+		rec = (void *) ((char *) map + sizeof(*header) +
+				(i % header->depth) * record_size);
+		printf("%lu.%06lu", (unsigned long) rec->tv.tv_sec,
+				(unsigned long) rec->tv.tv_usec);
+		for (j = 0; j < header->regs_count; j++)
+			if (names[j] || !config_file_name)
+				printf(",%li", rec->regs[j]);
+		printf("\n");
+	}
+
+	return 0;
+}
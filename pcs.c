@@ -19,15 +19,26 @@
 
 #include "includes.h"
 
+#include <errno.h>
 #include <signal.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 #include <sys/time.h>
 #include <time.h>
 #include <unistd.h>
 
 #include "block.h"
+#include "icpdas.h"
+#include "io-stage.h"
 #include "list.h"
+#include "modbus.h"
+#include "parallel.h"
+#include "pcs-clock.h"
+#include "profile.h"
+#include "realtime.h"
+#include "recorder.h"
+#include "scheduler.h"
 #include "serverconf.h"
 #include "state.h"
 
@@ -39,20 +50,76 @@ sigterm_handler(int sig)
 	received_signal = sig;
 }
 
+static int dump_requested = 0;
+
+static void
+sigusr1_handler(int sig)
+{
+	dump_requested = 1;
+}
+
+static void
+skip_ticks(struct server_state *s, long late)
+{
+	long tick = s->tick.tv_sec * 1000000 + s->tick.tv_usec;
+	long lost;
+
+	if (0 >= tick)
+		return;
+
+	for (lost = late / tick + 1; lost > 0; lost--) {
+		timeradd(&s->start, &s->tick, &s->start);
+		pcs_clock_add(&s->deadline, &s->tick);
+		s->ticks_lost++;
+	}
+}
+
 static void
 next_tick(struct server_state *s)
 {
-	struct timeval now;
+	struct timespec now;
 	long delay;
+	int err;
 
-	gettimeofday(&now, NULL);
-	delay = s->start.tv_usec - now.tv_usec +
-		1000000 * (s->start.tv_sec - now.tv_sec);
-	if (0 >= delay) {
+	timeradd(&s->start, &s->tick, &s->start);
+	pcs_clock_add(&s->deadline, &s->tick);
+
+	pcs_clock_now(&now);
+	delay = pcs_clock_diff(&s->deadline, &now);
+	s->late = 0 >= delay;
+	if (s->late) {
 		warn("missed tick by %li usec\n", -delay);
+		s->overruns++;
+		s->latency = 0;
+		/*
+		 * Catching up or shedding runs late ticks back to back, but
+		 * only s->burst of them in a row. The rest are skipped.
+		 */
+		if (PCS_OVERRUN_SKIP != s->overrun &&
+				s->late_ticks++ < s->burst)
+			return;
+		s->late_ticks = 0;
+		skip_ticks(s, -delay);
+	} else {
+		s->late_ticks = 0;
+	}
+	do {
+		err = clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME,
+				&s->deadline, NULL);
+	} while (EINTR == err && !received_signal);
+	if (err) {
+		if (EINTR != err)
+			error("clock_nanosleep: %s (%i)\n", strerror(err), err);
 		return;
 	}
-	usleep(delay);
+
+	pcs_clock_now(&now);
+	s->latency = pcs_clock_diff(&now, &s->deadline);
+	if (s->latency > s->max_latency)
+		s->max_latency = s->latency;
+	s->total_latency += s->latency;
+	s->wakeups++;
+	debug2("woke up %li usec late\n", s->latency);
 }
 
 int main(int argc, char **argv)
@@ -65,7 +132,14 @@ int main(int argc, char **argv)
 		.multiple	= 1,
        	};
 	struct server_state *s = &c.state;
+	struct scheduler sched;
+	struct parallel_pool *pool = NULL;
+	struct io_stage *io;
+	struct recorder *rec;
+	struct block **run;
 	struct block *b;
+	struct timespec tick_start;
+	unsigned int i, n;
 	int opt;
 	int no_detach = 0;
 	FILE *f;
@@ -98,15 +172,28 @@ int main(int argc, char **argv)
 		fatal("Bad configuration\n");
 	if (&c.block_list == c.block_list.next)
 		fatal("Nothing to do. Exiting\n");
+	icpdas_sysfs_set_root(c.io.root);
+	/* A test run must not truncate the capture file */
+	if (icpdas_io_setup(c.io.backend, c.io.file,
+				test_only ? NULL : c.io.capture))
+		fatal("Bad I/O configuration\n");
+	if (icpdas_check_modules(c.io.inventory ? c.io.inventory :
+				ICP_INVENTORY_FILE))
+		fatal("Configured modules do not match the backplane\n");
+	i = modbus_plan();
+	if (i)
+		debug("%u modbus requests a tick\n", i);
+	io = io_stage_init(&c);
+	scheduler_init(&sched, &c.block_list);
 	if (test_only)
 		return 0;
-	gettimeofday(&s->start, NULL);
-
 	if (!no_detach)
 		daemon(0, 0);
 
 	log_init("pcs", log_level, LOG_DAEMON, no_detach);
 
+	gettimeofday(&s->start, NULL);
+	pcs_clock_now(&s->deadline);
 	srand(s->start.tv_sec);
         f = fopen(pid_file, "w");
         if (f != NULL) {
@@ -119,6 +206,14 @@ int main(int argc, char **argv)
 	signal(SIGTERM, sigterm_handler);
 	signal(SIGQUIT, sigterm_handler);
 	signal(SIGINT, sigterm_handler);
+	signal(SIGUSR1, sigusr1_handler);
+
+	realtime_prepare(&c);
+	icpdas_serial_sync_mode(c.sync_analog);
+	pool = parallel_init(&c.block_list, c.threads);
+	io_stage_start(io, s);
+	rec = recorder_init(&c);
+	realtime_setup(&c);
 
 	while (1) {
 		char buff[24];
@@ -126,21 +221,62 @@ int main(int argc, char **argv)
 		strftime(&buff[0], sizeof(buff) - 1, "%b %e %H:%M:%S", &tm);
 		debug2("%s\n", buff);
 
-		list_for_each_entry(b, &c.block_list, block_entry) {
-			if (received_signal)
-				break;
-			if (--b->counter)
-				continue;
-			b->counter = b->multiple;
-			b->ops->run(b, s);
+		profile_start(&tick_start);
+		if (io) {
+			io_stage_publish(io);
+		} else {
+			modbus_sync();
+		}
+		n = scheduler_next(&sched, &run);
+		if (s->late && PCS_OVERRUN_SHED == s->overrun) {
+			i = scheduler_shed(&sched, &run, n);
+			s->shed += n - i;
+			n = i;
+		}
+		if (!io) {
+			scheduler_prepare(run, n, s);
+			icpdas_serial_sync();
+		}
+		if (pool) {
+			parallel_run(pool, run, n, s);
+		} else {
+			for (i = 0; i < n; i++) {
+				if (received_signal)
+					break;
+				b = run[i];
+				profile_run(b, s);
+			}
+		}
+		icpdas_commit_outputs();
+#ifdef PCS_PROFILE
+		profile_end(&s->tick_profile, &tick_start);
+#endif
+		if (dump_requested) {
+			dump_requested = 0;
+#ifdef PCS_PROFILE
+			profile_dump_tick(&s->tick_profile);
+#endif
+			profile_dump(&c.block_list);
+			io_stage_dump(io);
+			icpdas_serial_save_stats(ICP_STATS_FILE);
 		}
-		timeradd(&s->start, &s->tick, &s->start);
 
+		recorder_write(rec, s);
 		if (received_signal)
 			break;
 		next_tick(s);
 	}
 
+	parallel_stop(pool);
+	io_stage_stop(io);
+	recorder_stop(rec);
+
+	verbose("max wake-up latency %li usec, mean %llu usec\n",
+			s->max_latency,
+			s->wakeups ? s->total_latency / s->wakeups : 0);
+	verbose("%lu overruns, %lu ticks lost, %lu block runs shed\n",
+			s->overruns, s->ticks_lost, s->shed);
+
 	if (!no_detach)
 		closelog();
 
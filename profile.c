@@ -0,0 +1,98 @@
+/* profile.c -- block execution time profiler
+ * Copyright (C) 2014 Sergei Ianovich <ynvich@gmail.com>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 2 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public
+ * License along with this program; if not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+ * Boston, MA 02111-1307, USA.
+ */
+
+#include "includes.h"
+
+#include <stdio.h>
+
+#include "block.h"
+#include "list.h"
+#include "profile.h"
+#include "state.h"
+
+#ifdef PCS_PROFILE
+void
+profile_end(struct profile *p, const struct timespec *start)
+{
+	struct timespec now;
+	unsigned long ns, v;
+	int bucket = 0;
+
+	pcs_clock_now(&now);
+	ns = (now.tv_sec - start->tv_sec) * 1000000000 +
+		now.tv_nsec - start->tv_nsec;
+
+	if (!p->count || ns < p->min)
+		p->min = ns;
+	if (ns > p->max)
+		p->max = ns;
+	p->total += ns;
+	p->count++;
+
+	for (v = ns >> 1; v && bucket < PCS_PROFILE_BUCKETS - 1; v >>= 1)
+		bucket++;
+	p->hist[bucket]++;
+}
+
+static void
+dump_one(const char *name, struct profile *p)
+{
+	char buff[PCS_PROFILE_BUCKETS * 12];
+	int i, last, len = 0;
+
+	if (!p->count)
+		return;
+
+	for (last = PCS_PROFILE_BUCKETS - 1; last > 0; last--)
+		if (p->hist[last])
+			break;
+	for (i = 0; i <= last; i++)
+		len += snprintf(&buff[len], sizeof(buff) - len, " %lu",
+				p->hist[i]);
+
+	logit("%s: %lu runs, min %lu, mean %llu, max %lu ns, log2 ns:%s\n",
+			name, p->count, p->min, p->total / p->count, p->max,
+			buff);
+}
+
+void
+profile_dump_tick(struct profile *tick)
+{
+	dump_one("tick", tick);
+}
+
+void
+profile_dump(struct list_head *list)
+{
+	struct block *b;
+	char name[16];
+
+	if (!list)
+		return;
+
+	list_for_each_entry(b, list, block_entry) {
+		if (b->name[0]) {
+			dump_one(b->name, &b->profile);
+			continue;
+		}
+		snprintf(name, sizeof(name), "#%u", b->index);
+		dump_one(name, &b->profile);
+	}
+}
+#endif
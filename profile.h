@@ -0,0 +1,84 @@
+/* profile.h -- block execution time profiler
+ * Copyright (C) 2014 Sergei Ianovich <ynvich@gmail.com>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 2 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public
+ * License along with this program; if not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+ * Boston, MA 02111-1307, USA.
+ */   
+
+#ifndef _PCS_PROFILE_H
+#define _PCS_PROFILE_H
+
+#include <time.h>
+
+#include "block.h"
+#include "list.h"
+#include "pcs-clock.h"
+#include "state.h"
+
+struct profile;
+
+#ifdef PCS_PROFILE
+static inline void
+profile_start(struct timespec *ts)
+{
+	pcs_clock_now(ts);
+}
+
+void
+profile_end(struct profile *p, const struct timespec *start);
+
+void
+profile_dump_tick(struct profile *tick);
+
+void
+profile_dump(struct list_head *list);
+
+static inline void
+profile_run(struct block *b, struct server_state *s)
+{
+	struct timespec start;
+
+	profile_start(&start);
+	b->ops->run(b, s);
+	profile_end(&b->profile, &start);
+}
+#else
+static inline void
+profile_start(struct timespec *ts)
+{
+}
+
+static inline void
+profile_end(struct profile *p, const struct timespec *start)
+{
+}
+
+static inline void
+profile_dump_tick(struct profile *tick)
+{
+}
+
+static inline void
+profile_dump(struct list_head *list)
+{
+}
+
+static inline void
+profile_run(struct block *b, struct server_state *s)
+{
+	b->ops->run(b, s);
+}
+#endif
+#endif
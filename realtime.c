@@ -0,0 +1,108 @@
+/* realtime.c -- real-time execution profile
+ * Copyright (C) 2014 Sergei Ianovich <ynvich@gmail.com>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 2 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public
+ * License along with this program; if not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+ * Boston, MA 02111-1307, USA.
+ */
+
+#define _GNU_SOURCE
+#include "includes.h"
+
+#include <alloca.h>
+#include <errno.h>
+#include <sched.h>
+#include <string.h>
+#include <sys/mman.h>
+
+#include "realtime.h"
+#include "serverconf.h"
+
+/*
+ * Touches the stack the tick will use, so that growing it does not
+ * page fault on the first deep call.
+ */
+static void
+prefault_stack(int kbytes)
+{
+	volatile unsigned char *stack = alloca(kbytes * 1024);
+	int i;
+
+	for (i = 0; i < kbytes * 1024; i += 256)
+		stack[i] = 0;
+}
+
+static void
+prefault_regs(struct server_config *c)
+{
+	volatile long *reg = c->regs;
+	int i;
+
+	for (i = 0; i < c->regs_count; i++)
+		reg[i] = reg[i];
+}
+
+/*
+ * Called once from the tick thread before it starts any other thread,
+ * since the registers it touches are shared with them.
+ */
+void
+realtime_prepare(struct server_config *c)
+{
+	struct realtime_options *rt = &c->realtime;
+
+	if (!rt->enabled)
+		return;
+
+	if (rt->lock_memory && mlockall(MCL_CURRENT | MCL_FUTURE))
+		error("mlockall: %s\n", strerror(errno));
+
+	prefault_stack(rt->stack);
+	prefault_regs(c);
+}
+
+/*
+ * Called once, right before the first tick, from the tick thread. Threads
+ * started earlier keep their own scheduling and affinity.
+ */
+void
+realtime_setup(struct server_config *c)
+{
+	struct realtime_options *rt = &c->realtime;
+	struct sched_param param;
+	cpu_set_t set;
+
+	if (!rt->enabled)
+		return;
+
+	if (rt->cpu >= 0) {
+		CPU_ZERO(&set);
+		CPU_SET(rt->cpu, &set);
+		if (sched_setaffinity(0, sizeof(set), &set))
+			error("failed to pin to cpu %i: %s\n", rt->cpu,
+					strerror(errno));
+	}
+
+	if (rt->priority > 0) {
+		memset(&param, 0, sizeof(param));
+		param.sched_priority = rt->priority;
+		if (sched_setscheduler(0, SCHED_FIFO, &param))
+			error("failed to set SCHED_FIFO priority %i: %s\n",
+					rt->priority, strerror(errno));
+	}
+
+	xmalloc_seal();
+	verbose("real-time profile: priority %i, cpu %i, %i kB stack\n",
+			rt->priority, rt->cpu, rt->stack);
+}
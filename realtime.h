@@ -0,0 +1,39 @@
+/* realtime.h -- real-time execution profile
+ * Copyright (C) 2014 Sergei Ianovich <ynvich@gmail.com>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 2 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public
+ * License along with this program; if not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+ * Boston, MA 02111-1307, USA.
+ */   
+
+#ifndef _PCS_REALTIME_H
+#define _PCS_REALTIME_H
+
+#define PCS_RT_DEFAULT_STACK	64
+
+struct realtime_options {
+	int			enabled;
+	int			priority;
+	int			cpu;
+	int			lock_memory;
+	int			stack;
+};
+
+struct server_config;
+
+void
+realtime_prepare(struct server_config *c);
+void
+realtime_setup(struct server_config *c);
+#endif
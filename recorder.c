@@ -0,0 +1,121 @@
+/* recorder.c -- flight recorder of register snapshots
+ * Copyright (C) 2014 Sergei Ianovich <ynvich@gmail.com>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 2 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public
+ * License along with this program; if not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+ * Boston, MA 02111-1307, USA.
+ */
+
+#include "includes.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+#include "recorder.h"
+#include "serverconf.h"
+#include "state.h"
+
+/*
+ * The ring is a shared file mapping, so the last records reach the page
+ * cache even if pcs crashes in the middle of a tick. The ring of the
+ * previous run is kept as <path>.1, so a restart after a crash does not
+ * wipe it.
+ */
+struct recorder {
+	struct recorder_header	*header;
+	char			*records;
+	size_t			record_size;
+	size_t			size;
+	const long		*regs;
+};
+
+struct recorder *
+recorder_init(struct server_config *c)
+{
+	struct recorder *r;
+	char old[PATH_MAX];
+	void *map;
+	int fd;
+
+	if (!c->recorder_path)
+		return NULL;
+
+	snprintf(old, sizeof(old), "%s.1", c->recorder_path);
+	if (rename(c->recorder_path, old) && ENOENT != errno)
+		error("failed to rename %s: %s\n", c->recorder_path,
+				strerror(errno));
+
+	r = xzalloc(sizeof(*r));
+	r->regs = c->regs;
+	r->record_size = recorder_record_size(c->regs_used);
+	r->size = sizeof(*r->header) + r->record_size * c->recorder_depth;
+
+	fd = open(c->recorder_path, O_RDWR | O_CREAT | O_TRUNC, 0644);
+	if (0 > fd)
+		fatal("failed to open %s: %s\n", c->recorder_path,
+				strerror(errno));
+	if (ftruncate(fd, r->size))
+		fatal("failed to resize %s: %s\n", c->recorder_path,
+				strerror(errno));
+	map = mmap(NULL, r->size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+	if (MAP_FAILED == map)
+		fatal("failed to map %s: %s\n", c->recorder_path,
+				strerror(errno));
+	close(fd);
+
+	r->header = map;
+	r->records = (char *) map + sizeof(*r->header);
+	memcpy(r->header->magic, PCS_RECORDER_MAGIC,
+			sizeof(r->header->magic));
+	r->header->regs_count = c->regs_used;
+	r->header->depth = c->recorder_depth;
+	r->header->head = 0;
+	debug("recording %i registers for %u ticks to %s\n", c->regs_used,
+			c->recorder_depth, c->recorder_path);
+	return r;
+}
+
+void
+recorder_write(struct recorder *r, struct server_state *s)
+{
+	struct recorder_record *rec;
+	uint64_t head;
+
+	if (!r)
+		return;
+
+	head = r->header->head;
+	rec = (void *) &r->records[(head % r->header->depth) *
+		r->record_size];
+	rec->tv = s->start;
+	memcpy(rec->regs, r->regs, r->header->regs_count * sizeof(long));
+	__sync_synchronize();
+	r->header->head = head + 1;
+}
+
+void
+recorder_stop(struct recorder *r)
+{
+	if (!r)
+		return;
+
+	msync(r->header, r->size, MS_ASYNC);
+	munmap(r->header, r->size);
+	xfree(r);
+}
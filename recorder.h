@@ -0,0 +1,64 @@
+/* recorder.h -- flight recorder of register snapshots
+ * Copyright (C) 2014 Sergei Ianovich <ynvich@gmail.com>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 2 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public
+ * License along with this program; if not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+ * Boston, MA 02111-1307, USA.
+ */   
+
+#ifndef _PCS_RECORDER_H
+#define _PCS_RECORDER_H
+
+#include <stdint.h>
+#include <sys/time.h>
+
+#define PCS_RECORDER_MAGIC	"pcsrec1"
+#define PCS_RECORDER_DEFAULT_DEPTH	1024
+
+/*
+ * The file is a header followed by depth records. Record (head - 1) %
+ * depth is the newest one. Each record is the tick time followed by
+ * regs_count registers.
+ */
+struct recorder_header {
+	char			magic[8];
+	uint32_t		regs_count;
+	uint32_t		depth;
+	uint64_t		head;
+};
+
+struct recorder_record {
+	struct timeval		tv;
+	long			regs[];
+};
+
+struct server_config;
+struct server_state;
+struct recorder;
+
+static inline size_t
+recorder_record_size(uint32_t regs_count)
+{
+	return sizeof(struct recorder_record) + regs_count * sizeof(long);
+}
+
+struct recorder *
+recorder_init(struct server_config *c);
+
+void
+recorder_write(struct recorder *r, struct server_state *s);
+
+void
+recorder_stop(struct recorder *r);
+#endif
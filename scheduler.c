@@ -0,0 +1,156 @@
+/* scheduler.c -- multi-rate block scheduler
+ * Copyright (C) 2014 Sergei Ianovich <ynvich@gmail.com>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 2 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public
+ * License along with this program; if not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+ * Boston, MA 02111-1307, USA.
+ */
+
+#include "includes.h"
+
+#include "block.h"
+#include "list.h"
+#include "scheduler.h"
+
+static struct rate_group *
+find_group(struct scheduler *sched, struct block *b)
+{
+	struct rate_group *g;
+	unsigned int i;
+
+	for (i = 0; i < sched->groups_count; i++) {
+		g = &sched->groups[i];
+		if (g->multiple == b->multiple && g->counter == b->counter)
+			return g;
+	}
+
+	sched->groups = xrealloc(sched->groups, sched->groups_count + 1,
+			sizeof(*sched->groups));
+	g = &sched->groups[sched->groups_count++];
+	g->multiple = b->multiple;
+	g->counter = b->counter;
+	g->count = 0;
+	g->pos = 0;
+	g->blocks = NULL;
+	return g;
+}
+
+/*
+ * Groups blocks by their rate and initial counter. Each group keeps its
+ * blocks in block_list order, so merging due groups by block index
+ * restores the relative execution order of a plain list scan.
+ */
+void
+scheduler_init(struct scheduler *sched, struct list_head *block_list)
+{
+	struct rate_group *g;
+	struct block *b;
+	unsigned int i;
+
+	sched->groups_count = 0;
+	sched->groups = NULL;
+	sched->blocks_count = 0;
+
+	list_for_each_entry(b, block_list, block_entry) {
+		b->index = sched->blocks_count++;
+		g = find_group(sched, b);
+		g->blocks = xrealloc(g->blocks, g->count + 1,
+				sizeof(*g->blocks));
+		g->blocks[g->count++] = b;
+	}
+
+	sched->ready = xcalloc(sched->groups_count + 1,
+			sizeof(*sched->ready));
+	sched->run = xcalloc(sched->blocks_count + 1, sizeof(*sched->run));
+
+	for (i = 0; i < sched->groups_count; i++) {
+		g = &sched->groups[i];
+		debug("rate group %u: multiple %u, phase %u, %u blocks\n", i,
+				g->multiple, g->counter - 1, g->count);
+	}
+}
+
+/*
+ * Advances all rate groups by one tick and stores the blocks which are
+ * due in @run in block_list order. Returns the number of due blocks.
+ */
+unsigned int
+scheduler_next(struct scheduler *sched, struct block ***run)
+{
+	struct rate_group *g;
+	unsigned int i, best, due = 0, n = 0;
+
+	for (i = 0; i < sched->groups_count; i++) {
+		g = &sched->groups[i];
+		if (--g->counter)
+			continue;
+		g->counter = g->multiple;
+		g->pos = 0;
+		sched->ready[due++] = g;
+	}
+
+	if (0 == due)
+		return 0;
+	if (1 == due) {
+		*run = sched->ready[0]->blocks;
+		return sched->ready[0]->count;
+	}
+
+	while (due) {
+		best = 0;
+		for (i = 1; i < due; i++) {
+			g = sched->ready[i];
+			if (g->blocks[g->pos]->index <
+					sched->ready[best]->blocks[
+					sched->ready[best]->pos]->index)
+				best = i;
+		}
+		g = sched->ready[best];
+		sched->run[n++] = g->blocks[g->pos++];
+		if (g->pos == g->count)
+			sched->ready[best] = sched->ready[--due];
+	}
+
+	*run = sched->run;
+	return n;
+}
+
+/*
+ * Drops low-priority blocks from @run. Returns the number of blocks
+ * left to run.
+ */
+unsigned int
+scheduler_shed(struct scheduler *sched, struct block ***run, unsigned int n)
+{
+	struct block **from = *run;
+	unsigned int i, k = 0;
+
+	for (i = 0; i < n; i++)
+		if (from[i]->priority >= 0)
+			sched->run[k++] = from[i];
+
+	*run = sched->run;
+	return k;
+}
+
+void
+scheduler_prepare(struct block **run, unsigned int n,
+		struct server_state *s)
+{
+	unsigned int i;
+
+	for (i = 0; i < n; i++)
+		if (run[i]->ops->prepare)
+			run[i]->ops->prepare(run[i], s);
+}
@@ -0,0 +1,55 @@
+/* scheduler.h -- multi-rate block scheduler
+ * Copyright (C) 2014 Sergei Ianovich <ynvich@gmail.com>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 2 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public
+ * License along with this program; if not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+ * Boston, MA 02111-1307, USA.
+ */   
+
+#ifndef _PCS_SCHEDULER_H
+#define _PCS_SCHEDULER_H
+
+#include "block.h"
+#include "list.h"
+
+/* Blocks sharing a rate and a phase */
+struct rate_group {
+	unsigned int		multiple;
+	unsigned int		counter;
+	unsigned int		count;
+	unsigned int		pos;
+	struct block		**blocks;
+};
+
+struct scheduler {
+	unsigned int		groups_count;
+	struct rate_group	*groups;
+	struct rate_group	**ready;
+	unsigned int		blocks_count;
+	struct block		**run;
+};
+
+void
+scheduler_init(struct scheduler *sched, struct list_head *block_list);
+
+unsigned int
+scheduler_next(struct scheduler *sched, struct block ***run);
+
+unsigned int
+scheduler_shed(struct scheduler *sched, struct block ***run, unsigned int n);
+
+void
+scheduler_prepare(struct block **run, unsigned int n,
+		struct server_state *s);
+#endif
@@ -20,15 +20,19 @@
 #include "includes.h"
 
 #include <errno.h>
+#include <sched.h>
 #include <stdio.h>
 #include <string.h>
 #include <yaml.h>
 
 #include "block.h"
+#include "block_builder.h"
 #include "block-list.h"
+#include "icpdas.h"
 #include "list.h"
 #include "map.h"
 #include "pcs-parser.h"
+#include "recorder.h"
 #include "serverconf.h"
 
 static void
@@ -36,6 +40,13 @@ default_config(struct server_config *conf)
 {
 	conf->state.tick.tv_sec = 10;
 	conf->state.tick.tv_usec = 0;
+	conf->state.burst = PCS_OVERRUN_BURST;
+	conf->threads = 1;
+	conf->realtime.cpu = -1;
+	conf->realtime.lock_memory = 1;
+	conf->realtime.stack = PCS_RT_DEFAULT_STACK;
+	conf->recorder_depth = PCS_RECORDER_DEFAULT_DEPTH;
+	INIT_LIST_HEAD(&conf->pending_list);
 }
 
 static int
@@ -72,19 +83,437 @@ options_multiple_event(struct pcs_parser_node *node, yaml_event_t *event)
 	return 1;
 }
 
+static int
+options_overrun_event(struct pcs_parser_node *node, yaml_event_t *event)
+{
+	struct server_config *conf = node->state->data;
+	const char *val = (const char *) event->data.scalar.value;
+
+	if (YAML_SCALAR_EVENT != event->type)
+		return pcs_parser_unexpected_event(node, event);
+
+	if (!strcmp(val, "catch up"))
+		conf->state.overrun = PCS_OVERRUN_CATCH_UP;
+	else if (!strcmp(val, "skip"))
+		conf->state.overrun = PCS_OVERRUN_SKIP;
+	else if (!strcmp(val, "shed"))
+		conf->state.overrun = PCS_OVERRUN_SHED;
+	else
+		return pcs_parser_unexpected_key(node, event, val);
+	debug(" %s\n", val);
+	pcs_parser_remove_node(node);
+	return 1;
+}
+
+static int
+options_overrun_burst_event(struct pcs_parser_node *node,
+		yaml_event_t *event)
+{
+	struct server_config *conf = node->state->data;
+	long burst;
+
+	if (YAML_SCALAR_EVENT != event->type)
+		return pcs_parser_unexpected_event(node, event);
+
+	burst = pcs_parser_long(node, event, NULL);
+	if (burst < 0)
+		return pcs_parser_unexpected_event(node, event);
+	debug(" %li\n", burst);
+	conf->state.burst = burst;
+	pcs_parser_remove_node(node);
+	return 1;
+}
+
+static int
+options_async_input_event(struct pcs_parser_node *node, yaml_event_t *event)
+{
+	struct server_config *conf = node->state->data;
+
+	if (YAML_SCALAR_EVENT != event->type)
+		return pcs_parser_unexpected_event(node, event);
+
+	conf->async_input = pcs_parser_long(node, event, NULL);
+	debug(" %i\n", conf->async_input);
+	pcs_parser_remove_node(node);
+	return 1;
+}
+
+static int
+io_backend_event(struct pcs_parser_node *node, yaml_event_t *event)
+{
+	struct server_config *conf = node->state->data;
+	const char *val = (const char *) event->data.scalar.value;
+
+	if (YAML_SCALAR_EVENT != event->type)
+		return pcs_parser_unexpected_event(node, event);
+
+	debug(" %s\n", val);
+	conf->io.backend = strdup(val);
+	pcs_parser_remove_node(node);
+	return 1;
+}
+
+static int
+io_capture_event(struct pcs_parser_node *node, yaml_event_t *event)
+{
+	struct server_config *conf = node->state->data;
+	const char *val = (const char *) event->data.scalar.value;
+
+	if (YAML_SCALAR_EVENT != event->type)
+		return pcs_parser_unexpected_event(node, event);
+
+	debug(" %s\n", val);
+	conf->io.capture = strdup(val);
+	pcs_parser_remove_node(node);
+	return 1;
+}
+
+static int
+io_file_event(struct pcs_parser_node *node, yaml_event_t *event)
+{
+	struct server_config *conf = node->state->data;
+	const char *val = (const char *) event->data.scalar.value;
+
+	if (YAML_SCALAR_EVENT != event->type)
+		return pcs_parser_unexpected_event(node, event);
+
+	debug(" %s\n", val);
+	conf->io.file = strdup(val);
+	pcs_parser_remove_node(node);
+	return 1;
+}
+
+static int
+io_inventory_event(struct pcs_parser_node *node, yaml_event_t *event)
+{
+	struct server_config *conf = node->state->data;
+	const char *val = (const char *) event->data.scalar.value;
+
+	if (YAML_SCALAR_EVENT != event->type)
+		return pcs_parser_unexpected_event(node, event);
+
+	debug(" %s\n", val);
+	conf->io.inventory = strdup(val);
+	pcs_parser_remove_node(node);
+	return 1;
+}
+
+static int
+io_root_event(struct pcs_parser_node *node, yaml_event_t *event)
+{
+	struct server_config *conf = node->state->data;
+	const char *val = (const char *) event->data.scalar.value;
+
+	if (YAML_SCALAR_EVENT != event->type)
+		return pcs_parser_unexpected_event(node, event);
+
+	debug(" %s\n", val);
+	conf->io.root = strdup(val);
+	pcs_parser_remove_node(node);
+	return 1;
+}
+
+static int
+options_realtime_event(struct pcs_parser_node *node, yaml_event_t *event)
+{
+	struct server_config *conf = node->state->data;
+
+	conf->realtime.enabled = 1;
+	return pcs_parser_map(node, event);
+}
+
+static int
+realtime_cpu_event(struct pcs_parser_node *node, yaml_event_t *event)
+{
+	struct server_config *conf = node->state->data;
+
+	if (YAML_SCALAR_EVENT != event->type)
+		return pcs_parser_unexpected_event(node, event);
+
+	conf->realtime.cpu = pcs_parser_long(node, event, NULL);
+	debug(" %i\n", conf->realtime.cpu);
+	pcs_parser_remove_node(node);
+	return 1;
+}
+
+static int
+realtime_lock_memory_event(struct pcs_parser_node *node, yaml_event_t *event)
+{
+	struct server_config *conf = node->state->data;
+
+	if (YAML_SCALAR_EVENT != event->type)
+		return pcs_parser_unexpected_event(node, event);
+
+	conf->realtime.lock_memory = pcs_parser_long(node, event, NULL);
+	debug(" %i\n", conf->realtime.lock_memory);
+	pcs_parser_remove_node(node);
+	return 1;
+}
+
+static int
+realtime_priority_event(struct pcs_parser_node *node, yaml_event_t *event)
+{
+	struct server_config *conf = node->state->data;
+	long prio;
+
+	if (YAML_SCALAR_EVENT != event->type)
+		return pcs_parser_unexpected_event(node, event);
+
+	prio = pcs_parser_long(node, event, NULL);
+	if (prio < sched_get_priority_min(SCHED_FIFO) ||
+			prio > sched_get_priority_max(SCHED_FIFO))
+		fatal("bad real-time priority (%li) in %s at line %zu "
+				"column %zu\n",
+				prio,
+				node->state->filename,
+				event->start_mark.line,
+				event->start_mark.column);
+	debug(" %li\n", prio);
+	conf->realtime.priority = prio;
+	pcs_parser_remove_node(node);
+	return 1;
+}
+
+static int
+realtime_stack_event(struct pcs_parser_node *node, yaml_event_t *event)
+{
+	struct server_config *conf = node->state->data;
+	long kbytes;
+
+	if (YAML_SCALAR_EVENT != event->type)
+		return pcs_parser_unexpected_event(node, event);
+
+	kbytes = pcs_parser_long(node, event, NULL);
+	if (kbytes < 0 || kbytes > 8192)
+		fatal("bad stack size (%li kB) in %s at line %zu column %zu\n",
+				kbytes,
+				node->state->filename,
+				event->start_mark.line,
+				event->start_mark.column);
+	debug(" %li kB\n", kbytes);
+	conf->realtime.stack = kbytes;
+	pcs_parser_remove_node(node);
+	return 1;
+}
+
+static int
+options_recorder_event(struct pcs_parser_node *node, yaml_event_t *event)
+{
+	struct server_config *conf = node->state->data;
+	const char *val = (const char *) event->data.scalar.value;
+
+	if (YAML_SCALAR_EVENT != event->type)
+		return pcs_parser_unexpected_event(node, event);
+
+	debug(" %s\n", val);
+	conf->recorder_path = strdup(val);
+	pcs_parser_remove_node(node);
+	return 1;
+}
+
+static int
+options_recorder_depth_event(struct pcs_parser_node *node,
+		yaml_event_t *event)
+{
+	struct server_config *conf = node->state->data;
+	long depth;
+
+	if (YAML_SCALAR_EVENT != event->type)
+		return pcs_parser_unexpected_event(node, event);
+
+	depth = pcs_parser_long(node, event, NULL);
+	if (depth < 1)
+		fatal("bad recorder depth (%li) in %s at line %zu column %zu\n",
+				depth,
+				node->state->filename,
+				event->start_mark.line,
+				event->start_mark.column);
+	debug(" %li\n", depth);
+	conf->recorder_depth = depth;
+	pcs_parser_remove_node(node);
+	return 1;
+}
+
+static int
+options_stagger_event(struct pcs_parser_node *node, yaml_event_t *event)
+{
+	struct server_config *conf = node->state->data;
+
+	if (YAML_SCALAR_EVENT != event->type)
+		return pcs_parser_unexpected_event(node, event);
+
+	conf->stagger = pcs_parser_long(node, event, NULL);
+	debug(" %i\n", conf->stagger);
+	pcs_parser_remove_node(node);
+	return 1;
+}
+
+static int
+options_threads_event(struct pcs_parser_node *node, yaml_event_t *event)
+{
+	struct server_config *conf = node->state->data;
+	long threads;
+
+	if (YAML_SCALAR_EVENT != event->type)
+		return pcs_parser_unexpected_event(node, event);
+
+	threads = pcs_parser_long(node, event, NULL);
+	if (threads < 1 || threads > PCS_MAX_THREADS)
+		fatal("bad thread count (%li) in %s at line %zu column %zu\n",
+				threads,
+				node->state->filename,
+				event->start_mark.line,
+				event->start_mark.column);
+	debug(" %li\n", threads);
+	conf->threads = threads;
+	pcs_parser_remove_node(node);
+	return 1;
+}
+
+static int
+options_sync_analog_event(struct pcs_parser_node *node, yaml_event_t *event)
+{
+	struct server_config *conf = node->state->data;
+
+	if (YAML_SCALAR_EVENT != event->type)
+		return pcs_parser_unexpected_event(node, event);
+
+	conf->sync_analog = pcs_parser_long(node, event, NULL);
+	debug(" %i\n", conf->sync_analog);
+	pcs_parser_remove_node(node);
+	return 1;
+}
+
 static int
 options_tick_event(struct pcs_parser_node *node, yaml_event_t *event)
 {
-	long msec;
+	long msec;
+	struct server_config *conf = node->state->data;
+
+	if (YAML_SCALAR_EVENT != event->type)
+		return pcs_parser_unexpected_event(node, event);
+
+	msec = pcs_parser_long(node, event, NULL);
+	debug(" %li ms\n", msec);
+	conf->state.tick.tv_sec = msec / 1000;
+	conf->state.tick.tv_usec = (msec % 1000) * 1000;
+	pcs_parser_remove_node(node);
+	return 1;
+}
+
+static void
+simulator_error(struct pcs_parser_node *node, yaml_event_t *event)
+{
+	fatal("bad simulator %s in %s at line %zu column %zu\n",
+			(const char *) &node[1],
+			node->state->filename,
+			event->start_mark.line,
+			event->start_mark.column);
+}
+
+static int
+simulator_slot_event(struct pcs_parser_node *node, yaml_event_t *event)
+{
+	struct server_config *conf = node->state->data;
+	const char *key = (const char *) &node[1];
+	char *end;
+
+	if (YAML_MAPPING_START_EVENT != event->type)
+		return pcs_parser_unexpected_event(node, event);
+
+	conf->sim_slot = strtoul(key, &end, 0);
+	if (*end || conf->sim_slot == 0 || conf->sim_slot > 8)
+		fatal("bad simulator slot (%s) in %s at line %zu column %zu\n",
+				key,
+				node->state->filename,
+				event->start_mark.line,
+				event->start_mark.column);
+	return pcs_parser_map(node, event);
+}
+
+static int
+simulator_model_event(struct pcs_parser_node *node, yaml_event_t *event)
+{
+	struct server_config *conf = node->state->data;
+	const char *val = (const char *) event->data.scalar.value;
+
+	if (YAML_SCALAR_EVENT != event->type)
+		return pcs_parser_unexpected_event(node, event);
+
+	debug(" %s\n", val);
+	if (icpdas_sim_set_model(conf->sim_slot, val))
+		simulator_error(node, event);
+	pcs_parser_remove_node(node);
+	return 1;
+}
+
+static int
+simulator_latency_event(struct pcs_parser_node *node, yaml_event_t *event)
+{
+	struct server_config *conf = node->state->data;
+	long usec;
+
+	if (YAML_SCALAR_EVENT != event->type)
+		return pcs_parser_unexpected_event(node, event);
+
+	usec = pcs_parser_long(node, event, NULL);
+	debug(" %li usec\n", usec);
+	if (icpdas_sim_set_latency(conf->sim_slot, usec))
+		simulator_error(node, event);
+	pcs_parser_remove_node(node);
+	return 1;
+}
+
+static int
+simulator_jitter_event(struct pcs_parser_node *node, yaml_event_t *event)
+{
+	struct server_config *conf = node->state->data;
+	long usec;
+
+	if (YAML_SCALAR_EVENT != event->type)
+		return pcs_parser_unexpected_event(node, event);
+
+	usec = pcs_parser_long(node, event, NULL);
+	debug(" %li usec\n", usec);
+	if (icpdas_sim_set_jitter(conf->sim_slot, usec))
+		simulator_error(node, event);
+	pcs_parser_remove_node(node);
+	return 1;
+}
+
+static int
+simulator_inputs_event(struct pcs_parser_node *node, yaml_event_t *event)
+{
+	struct server_config *conf = node->state->data;
+	long inputs;
+
+	if (YAML_SCALAR_EVENT != event->type)
+		return pcs_parser_unexpected_event(node, event);
+
+	inputs = pcs_parser_long(node, event, NULL);
+	debug(" 0x%08lx\n", inputs);
+	if (icpdas_sim_set_inputs(conf->sim_slot, inputs))
+		simulator_error(node, event);
+	pcs_parser_remove_node(node);
+	return 1;
+}
+
+static int
+simulator_signal_event(struct pcs_parser_node *node, yaml_event_t *event)
+{
 	struct server_config *conf = node->state->data;
+	const char *key = (const char *) &node[1];
+	const char *val = (const char *) event->data.scalar.value;
+	char *end;
+	unsigned long channel;
 
 	if (YAML_SCALAR_EVENT != event->type)
 		return pcs_parser_unexpected_event(node, event);
 
-	msec = pcs_parser_long(node, event, NULL);
-	debug(" %li ms\n", msec);
-	conf->state.tick.tv_sec = msec / 1000;
-	conf->state.tick.tv_usec = (msec % 1000) * 1000;
+	debug(" %s\n", val);
+	channel = strtoul(key, &end, 0);
+	if (*end || icpdas_sim_set_signal(conf->sim_slot, channel, val))
+		simulator_error(node, event);
 	pcs_parser_remove_node(node);
 	return 1;
 }
@@ -178,6 +607,7 @@ register_output(struct server_config *c, struct block *b)
 
 	if (NULL == outputs[0]) {
 		b->outputs = reg;
+		b->outputs_count = 1;
 		c->regs_used++;
 		if (c->regs_used == c->regs_count)
 			fatal("%i registers are not enough\n", c->regs_count);
@@ -189,11 +619,13 @@ register_output(struct server_config *c, struct block *b)
 			fatal("%i registers are not enough\n", c->regs_count);
 	}
 	b->outputs = reg;
+	b->outputs_count = i;
 	debug3(" %s: %i outputs\n", b->name, i);
 }
 
 static long *
-find_output(struct list_head *list, const char const *key)
+find_output(struct list_head *list, const char const *key,
+		struct block **src)
 {
 	struct block *b;
 	const char **outputs;
@@ -202,7 +634,7 @@ find_output(struct list_head *list, const char const *key)
 
 	list_for_each_entry(b, list, block_entry) {
 		outputs = b->outputs_table;
-		if (!outputs)
+		if (!outputs || !b->outputs)
 			continue;
 
 		len = strlen(b->name);
@@ -211,6 +643,7 @@ find_output(struct list_head *list, const char const *key)
 
 		if (strncmp(key, b->name, len))
 			continue;
+		*src = b;
 		if (NULL == outputs[0]) {
 			if (strlen(key) == len)
 				return b->outputs;
@@ -226,6 +659,49 @@ find_output(struct list_head *list, const char const *key)
 	return NULL;
 }
 
+static void
+add_dependency(struct block *b, struct block *src)
+{
+	unsigned int i;
+
+	for (i = 0; i < b->deps_count; i++)
+		if (b->deps[i] == src)
+			return;
+
+	b->deps = xrealloc(b->deps, b->deps_count + 1, sizeof(*b->deps));
+	b->deps[b->deps_count++] = src;
+}
+
+/* An input which refers to a block without registered outputs yet */
+struct pending_input {
+	struct list_head	pending_entry;
+	struct block		*block;
+	void			(*set_input)(void *, const char const *,
+					long *);
+	char			*key;
+	char			*input;
+	size_t			line;
+	size_t			column;
+};
+
+static void
+defer_input(struct pcs_parser_node *node, yaml_event_t *event,
+		struct block *b,
+		void (*set_input)(void *, const char const *, long *))
+{
+	struct server_config *conf = node->state->data;
+	struct pending_input *p = xzalloc(sizeof(*p));
+
+	p->block = b;
+	p->set_input = set_input;
+	p->key = strdup((const char *) &node[1]);
+	p->input = strdup((const char *) event->data.scalar.value);
+	p->line = event->start_mark.line;
+	p->column = event->start_mark.column;
+	list_add_tail(&p->pending_entry, &conf->pending_list);
+	debug(" %s (deferred)\n", p->input);
+}
+
 static int
 block_input_event(struct pcs_parser_node *node, yaml_event_t *event)
 {
@@ -235,6 +711,7 @@ block_input_event(struct pcs_parser_node *node, yaml_event_t *event)
 	const char *input = (const char *) event->data.scalar.value;
 	const char *key = (const char *) &node[1];
 	void (*set_input)(void *, const char const *, long *);
+	struct block *src;
 	long *reg;
 
 	if (0 == node->sequence && YAML_SEQUENCE_START_EVENT == event->type) {
@@ -259,12 +736,14 @@ block_input_event(struct pcs_parser_node *node, yaml_event_t *event)
 				node->state->filename,
 				event->start_mark.line,
 				event->start_mark.column);
-	reg = find_output(&conf->block_list, input);
-	if (!reg)
-		return pcs_parser_unexpected_key(node, event, input);
-
-	set_input(b->data, key, reg);
-	debug(" %s\n", input);
+	reg = find_output(&conf->block_list, input, &src);
+	if (reg) {
+		set_input(b->data, key, reg);
+		add_dependency(b, src);
+		debug(" %s\n", input);
+	} else {
+		defer_input(node, event, b, set_input);
+	}
 	if (1 != node->sequence)
 		pcs_parser_remove_node(node);
 	return 1;
@@ -295,6 +774,47 @@ block_multiple_event(struct pcs_parser_node *node, yaml_event_t *event)
 	return 1;
 }
 
+static int
+block_phase_event(struct pcs_parser_node *node, yaml_event_t *event)
+{
+	struct server_config *conf = node->state->data;
+	struct block *b = list_entry(conf->block_list.prev,
+			struct block, block_entry);
+	long phase;
+
+	if (YAML_SCALAR_EVENT != event->type)
+		return pcs_parser_unexpected_event(node, event);
+
+	phase = pcs_parser_long(node, event, NULL);
+	if (phase < 0)
+		fatal("negative phase in %s at line %zu column %zu\n",
+				node->state->filename,
+				event->start_mark.line,
+				event->start_mark.column);
+	b->phase = (int) phase;
+	debug(" %i\n", b->phase);
+
+	pcs_parser_remove_node(node);
+	return 1;
+}
+
+static int
+block_priority_event(struct pcs_parser_node *node, yaml_event_t *event)
+{
+	struct server_config *conf = node->state->data;
+	struct block *b = list_entry(conf->block_list.prev,
+			struct block, block_entry);
+
+	if (YAML_SCALAR_EVENT != event->type)
+		return pcs_parser_unexpected_event(node, event);
+
+	b->priority = (int) pcs_parser_long(node, event, NULL);
+	debug(" %i\n", b->priority);
+
+	pcs_parser_remove_node(node);
+	return 1;
+}
+
 static int
 block_name_event(struct pcs_parser_node *node, yaml_event_t *event)
 {
@@ -314,6 +834,28 @@ block_name_event(struct pcs_parser_node *node, yaml_event_t *event)
 	return 1;
 }
 
+static int
+has_pending_inputs(struct server_config *conf, struct block *b)
+{
+	struct pending_input *p;
+
+	list_for_each_entry(p, &conf->pending_list, pending_entry)
+		if (p->block == b)
+			return 1;
+	return 0;
+}
+
+static int
+init_block(struct server_config *conf, struct block *b)
+{
+	b->ops = b->builder->ops(b);
+	if (!b->ops || !b->ops->run)
+		return -1;
+	if (!b->outputs)
+		register_output(conf, b);
+	return 0;
+}
+
 static int
 end_block_event(struct pcs_parser_node *node, yaml_event_t *event)
 {
@@ -323,14 +865,24 @@ end_block_event(struct pcs_parser_node *node, yaml_event_t *event)
 			struct block, block_entry);
 
 	debug3("%s:%i\n", __FUNCTION__, __LINE__);
-	b->ops = b->builder->ops(b);
-	if (!b->ops || !b->ops->run)
+	if (0 <= b->phase && (unsigned int) b->phase >= b->multiple)
+		fatal("phase %i of %s is not below its multiple %u in %s "
+				"at line %zu column %zu\n", b->phase, key,
+				b->multiple, node->state->filename,
+				event->start_mark.line,
+				event->start_mark.column);
+	if (has_pending_inputs(conf, b)) {
+		/* Static outputs may already be referred to */
+		if (b->outputs_table)
+			register_output(conf, b);
+		return pcs_parser_up(node, event);
+	}
+	if (init_block(conf, b))
 		fatal("bad config for %s in %s at line %zu column %zu\n",
 				key,
 				node->state->filename,
 				event->start_mark.line,
 				event->start_mark.column);
-	register_output(conf, b);
 
 	return pcs_parser_up(node, event);
 }
@@ -358,6 +910,7 @@ new_block_event(struct pcs_parser_node *node, yaml_event_t *event)
 	b = xzalloc(sizeof(*b));
 	b->multiple = conf->multiple;
 	b->counter = 1;
+	b->phase = -1;
 	b->builder = builder;
 	b->outputs_table = builder->outputs;
 	if (builder->alloc)
@@ -391,11 +944,99 @@ blocks_start_event(struct pcs_parser_node *node, yaml_event_t *event)
 	return 1;
 }
 
+static struct pcs_parser_map realtime_map[] = {
+	{
+		.key			= "cpu",
+		.handler		= realtime_cpu_event,
+	}
+	,{
+		.key			= "lock memory",
+		.handler		= realtime_lock_memory_event,
+	}
+	,{
+		.key			= "priority",
+		.handler		= realtime_priority_event,
+	}
+	,{
+		.key			= "stack",
+		.handler		= realtime_stack_event,
+	}
+	,{
+	}
+};
+
+static struct pcs_parser_map io_map[] = {
+	{
+		.key			= "backend",
+		.handler		= io_backend_event,
+	}
+	,{
+		.key			= "capture",
+		.handler		= io_capture_event,
+	}
+	,{
+		.key			= "file",
+		.handler		= io_file_event,
+	}
+	,{
+		.key			= "inventory",
+		.handler		= io_inventory_event,
+	}
+	,{
+		.key			= "root",
+		.handler		= io_root_event,
+	}
+	,{
+	}
+};
+
 static struct pcs_parser_map options_map[] = {
 	{
+		.key			= "async input",
+		.handler		= options_async_input_event,
+	}
+	,{
+		.key			= "io",
+		.handler		= pcs_parser_map,
+		.data			= &io_map,
+	}
+	,{
 		.key			= "multiple",
 		.handler		= options_multiple_event,
 	}
+	,{
+		.key			= "overrun",
+		.handler		= options_overrun_event,
+	}
+	,{
+		.key			= "overrun burst",
+		.handler		= options_overrun_burst_event,
+	}
+	,{
+		.key			= "realtime",
+		.handler		= options_realtime_event,
+		.data			= &realtime_map,
+	}
+	,{
+		.key			= "recorder",
+		.handler		= options_recorder_event,
+	}
+	,{
+		.key			= "recorder depth",
+		.handler		= options_recorder_depth_event,
+	}
+	,{
+		.key			= "stagger",
+		.handler		= options_stagger_event,
+	}
+	,{
+		.key			= "sync analog",
+		.handler		= options_sync_analog_event,
+	}
+	,{
+		.key			= "threads",
+		.handler		= options_threads_event,
+	}
 	,{
 		.key			= "tick",
 		.handler		= options_tick_event,
@@ -446,6 +1087,14 @@ static struct pcs_parser_map block_map[] = {
 		.key			= "name",
 		.handler		= block_name_event,
 	}
+	,{
+		.key			= "phase",
+		.handler		= block_phase_event,
+	}
+	,{
+		.key			= "priority",
+		.handler		= block_priority_event,
+	}
 	,{
 		.key			= "setpoint",
 		.handler		= new_setpoint_event,
@@ -473,6 +1122,49 @@ static struct pcs_parser_map blocks_map[] = {
 	}
 };
 
+static struct pcs_parser_map signals_map[] = {
+	{
+		.handler		= simulator_signal_event,
+	}
+	,{
+	}
+};
+
+static struct pcs_parser_map sim_module_map[] = {
+	{
+		.key			= "inputs",
+		.handler		= simulator_inputs_event,
+	}
+	,{
+		.key			= "jitter",
+		.handler		= simulator_jitter_event,
+	}
+	,{
+		.key			= "latency",
+		.handler		= simulator_latency_event,
+	}
+	,{
+		.key			= "model",
+		.handler		= simulator_model_event,
+	}
+	,{
+		.key			= "signals",
+		.handler		= pcs_parser_map,
+		.data			= &signals_map,
+	}
+	,{
+	}
+};
+
+static struct pcs_parser_map simulator_map[] = {
+	{
+		.handler		= simulator_slot_event,
+		.data			= &sim_module_map,
+	}
+	,{
+	}
+};
+
 static struct pcs_parser_map top_map[] = {
 	{
 		.key			= "options",
@@ -484,6 +1176,11 @@ static struct pcs_parser_map top_map[] = {
 		.handler		= blocks_start_event,
 		.data			= &blocks_map,
 	}
+	,{
+		.key			= "simulator",
+		.handler		= pcs_parser_map,
+		.data			= &simulator_map,
+	}
 	,{
 	}
 };
@@ -502,10 +1199,360 @@ static struct pcs_parser_map stream_map = {
 		.data			= &document_map,
 };
 
+/*
+ * Resolves inputs which refer to blocks declared later in the file, and
+ * initializes the blocks waiting for them.
+ */
+static int
+resolve_inputs(const char const *filename, struct server_config *conf)
+{
+	struct pending_input *p, *tmp;
+	struct block *b, *src;
+	int progress = 1;
+	long *reg;
+
+	while (progress) {
+		progress = 0;
+		list_for_each_entry_safe(p, tmp, &conf->pending_list,
+				pending_entry) {
+			reg = find_output(&conf->block_list, p->input, &src);
+			if (!reg)
+				continue;
+			b = p->block;
+			p->set_input(b->data, p->key, reg);
+			add_dependency(b, src);
+			debug("%s: %s %s\n", b->name, p->key, p->input);
+			list_del(&p->pending_entry);
+			xfree(p->key);
+			xfree(p->input);
+			xfree(p);
+			progress = 1;
+			if (has_pending_inputs(conf, b))
+				continue;
+			if (init_block(conf, b))
+				fatal("bad config for %s in %s\n", b->name,
+						filename);
+		}
+	}
+
+	if (list_empty(&conf->pending_list))
+		return 0;
+
+	list_for_each_entry(p, &conf->pending_list, pending_entry)
+		error("unexpected key %s in %s at line %zu column %zu\n",
+				p->input, filename, p->line, p->column);
+	return 1;
+}
+
+static int
+block_writes_inputs(struct block *b)
+{
+	return b->builder && (b->builder->flags & PCS_BLOCK_WRITES_INPUTS);
+}
+
+static void
+add_edge(unsigned int **preds, unsigned int *count, unsigned int to,
+		unsigned int from)
+{
+	unsigned int i;
+
+	if (to == from)
+		return;
+	for (i = 0; i < count[to]; i++)
+		if (preds[to][i] == from)
+			return;
+	preds[to] = xrealloc(preds[to], count[to] + 1, sizeof(**preds));
+	preds[to][count[to]++] = from;
+}
+
+struct sort_graph {
+	unsigned int		n;
+	unsigned int		**preds;
+	unsigned int		*preds_count;
+	unsigned int		**succs;
+	unsigned int		*succs_count;
+	char			*done;
+	char			*mark;
+	unsigned int		*queue;
+};
+
+/* Marks undone blocks reachable from @i along @edges with @bit */
+static void
+sort_graph_walk(struct sort_graph *g, unsigned int i, unsigned int **edges,
+		unsigned int *count, char bit)
+{
+	unsigned int head = 0, tail = 0, j, k;
+
+	g->queue[tail++] = i;
+	while (head < tail) {
+		k = g->queue[head++];
+		for (j = 0; j < count[k]; j++) {
+			i = edges[k][j];
+			if (g->done[i] || (g->mark[i] & bit))
+				continue;
+			g->mark[i] |= bit;
+			g->queue[tail++] = i;
+		}
+	}
+}
+
+/*
+ * Returns the first undone block of a feedback loop which does not wait
+ * for any other block.
+ */
+static unsigned int
+sort_graph_loop(struct sort_graph *g)
+{
+	unsigned int i, j;
+
+	for (i = 0; i < g->n; i++) {
+		if (g->done[i])
+			continue;
+		memset(g->mark, 0, g->n);
+		sort_graph_walk(g, i, g->preds, g->preds_count, 1);
+		if (!(g->mark[i] & 1))
+			continue;
+		sort_graph_walk(g, i, g->succs, g->succs_count, 2);
+		for (j = 0; j < g->n; j++)
+			if (g->mark[j] == 1)
+				break;
+		if (j == g->n)
+			return i;
+	}
+	return g->n;
+}
+
+/*
+ * Orders blocks so that each block runs after the blocks it reads from,
+ * keeping the file order where the wiring allows. Blocks writing to their
+ * inputs stay where they are relative to all other blocks. A feedback
+ * loop is broken at its first block in the file: it reads the rest of
+ * the loop with a delay of one tick.
+ */
+static void
+sort_blocks(struct server_config *conf)
+{
+	struct sort_graph g;
+	struct block **blocks, *b;
+	unsigned int *waiting;
+	unsigned int n = 0, i, j, k, best, barrier = 0;
+	int have_barrier = 0;
+	LIST_HEAD(sorted);
+
+	list_for_each_entry(b, &conf->block_list, block_entry)
+		b->index = n++;
+	if (!n)
+		return;
+
+	g.n = n;
+	g.preds = xcalloc(n, sizeof(*g.preds));
+	g.preds_count = xcalloc(n, sizeof(*g.preds_count));
+	g.succs = xcalloc(n, sizeof(*g.succs));
+	g.succs_count = xcalloc(n, sizeof(*g.succs_count));
+	g.done = xcalloc(n, sizeof(*g.done));
+	g.mark = xcalloc(n, sizeof(*g.mark));
+	g.queue = xcalloc(n, sizeof(*g.queue));
+	blocks = xcalloc(n, sizeof(*blocks));
+	waiting = xcalloc(n, sizeof(*waiting));
+	list_for_each_entry(b, &conf->block_list, block_entry)
+		blocks[b->index] = b;
+
+	for (i = 0; i < n; i++) {
+		b = blocks[i];
+		for (j = 0; j < b->deps_count; j++)
+			add_edge(g.preds, g.preds_count, i, b->deps[j]->index);
+		if (have_barrier)
+			add_edge(g.preds, g.preds_count, i, barrier);
+		if (!block_writes_inputs(b))
+			continue;
+		for (j = have_barrier ? barrier : 0; j < i; j++)
+			add_edge(g.preds, g.preds_count, i, j);
+		barrier = i;
+		have_barrier = 1;
+	}
+	for (i = 0; i < n; i++) {
+		waiting[i] = g.preds_count[i];
+		for (j = 0; j < g.preds_count[i]; j++)
+			add_edge(g.succs, g.succs_count, g.preds[i][j], i);
+	}
+
+	for (k = 0; k < n; k++) {
+		best = n;
+		for (i = 0; i < n && best == n; i++)
+			if (!g.done[i] && !waiting[i])
+				best = i;
+		if (best == n) {
+			best = sort_graph_loop(&g);
+			if (best == n)
+				fatal("%s: cannot order blocks\n", __FUNCTION__);
+			for (j = 0; j < g.preds_count[best]; j++)
+				if (!g.done[g.preds[best][j]])
+					logit("%s: reads %s from the previous "
+							"tick (feedback loop)\n",
+							blocks[best]->name,
+							blocks[g.preds[best][j]]->name);
+		}
+		g.done[best] = 1;
+		list_move_tail(&blocks[best]->block_entry, &sorted);
+		if (best != k)
+			debug("%s: moved from %u to %u\n",
+					blocks[best]->name, best, k);
+		for (j = 0; j < g.succs_count[best]; j++)
+			waiting[g.succs[best][j]]--;
+	}
+	list_splice(&sorted, &conf->block_list);
+
+	for (i = 0; i < n; i++) {
+		if (g.preds[i])
+			xfree(g.preds[i]);
+		if (g.succs[i])
+			xfree(g.succs[i]);
+	}
+	xfree(waiting);
+	xfree(blocks);
+	xfree(g.queue);
+	xfree(g.mark);
+	xfree(g.done);
+	xfree(g.succs_count);
+	xfree(g.succs);
+	xfree(g.preds_count);
+	xfree(g.preds);
+}
+
+static unsigned int
+find_chain(unsigned int *parent, unsigned int i)
+{
+	while (parent[i] != i)
+		i = parent[i] = parent[parent[i]];
+	return i;
+}
+
+/*
+ * Blocks of the same rate connected through their inputs form a chain,
+ * which has to run in a single tick. With stagger on, chains sharing a
+ * rate are spread evenly across their period. A chain with an explicit
+ * phase keeps it, and the others fill the least busy phases around it.
+ */
+static void
+stagger_blocks(struct server_config *conf)
+{
+	struct block **blocks, *b;
+	unsigned int *parent;
+	int *phase;
+	unsigned int *load;
+	unsigned int n = 0, i, j, a, z, m, k, p, best, chains;
+
+	list_for_each_entry(b, &conf->block_list, block_entry)
+		b->index = n++;
+	if (!n)
+		return;
+
+	blocks = xcalloc(n, sizeof(*blocks));
+	parent = xcalloc(n, sizeof(*parent));
+	phase = xcalloc(n, sizeof(*phase));
+	i = 0;
+	list_for_each_entry(b, &conf->block_list, block_entry) {
+		blocks[i] = b;
+		parent[i] = i;
+		phase[i] = -1;
+		i++;
+	}
+
+	for (i = 0; i < n; i++) {
+		b = blocks[i];
+		for (j = 0; j < b->deps_count; j++) {
+			if (b->deps[j]->multiple != b->multiple)
+				continue;
+			a = find_chain(parent, i);
+			z = find_chain(parent, b->deps[j]->index);
+			if (a < z)
+				parent[z] = a;
+			else
+				parent[a] = z;
+		}
+	}
+
+	for (i = 0; i < n; i++) {
+		if (0 > blocks[i]->phase)
+			continue;
+		a = find_chain(parent, i);
+		if (0 > phase[a])
+			phase[a] = blocks[i]->phase;
+		else if (phase[a] != blocks[i]->phase)
+			warn("%s: phase %i ignored, chain runs at phase %i\n",
+					blocks[i]->name, blocks[i]->phase,
+					phase[a]);
+	}
+
+	for (i = 0; i < n; i++) {
+		m = blocks[i]->multiple;
+		if (parent[i] != i || 0 <= phase[i])
+			continue;
+		if (m <= 1 || !conf->stagger) {
+			phase[i] = 0;
+			continue;
+		}
+		load = xcalloc(m, sizeof(*load));
+		chains = 0;
+		for (j = 0; j < n; j++) {
+			if (parent[j] != j || blocks[j]->multiple != m)
+				continue;
+			if (0 <= phase[j])
+				load[phase[j]]++;
+			else
+				chains++;
+		}
+		/*
+		 * Each chain goes to the least busy phase at or after its
+		 * even share of the period.
+		 */
+		k = 0;
+		for (j = i; j < n; j++) {
+			if (parent[j] != j || 0 <= phase[j] ||
+					blocks[j]->multiple != m)
+				continue;
+			z = k++ * m / chains;
+			best = z;
+			for (p = 1; p < m; p++)
+				if (load[(z + p) % m] < load[best])
+					best = (z + p) % m;
+			phase[j] = best;
+			load[best]++;
+		}
+		xfree(load);
+	}
+
+	for (i = 0; i < n; i++) {
+		b = blocks[i];
+		if (!b->multiple)
+			continue;
+		b->counter = 1 + phase[find_chain(parent, i)] % b->multiple;
+		if (1 != b->counter)
+			debug("%s: phase %u of %u\n", b->name,
+					b->counter - 1, b->multiple);
+	}
+
+	xfree(phase);
+	xfree(parent);
+	xfree(blocks);
+}
+
 int
 load_server_config(const char const *filename, struct server_config *conf)
 {
+	int err;
+
 	default_config(conf);
 
-	return pcs_parse_yaml(filename, &stream_map, conf);
+	err = pcs_parse_yaml(filename, &stream_map, conf);
+	if (err)
+		return err;
+
+	err = resolve_inputs(filename, conf);
+	if (err)
+		return err;
+
+	sort_blocks(conf);
+	stagger_blocks(conf);
+	return 0;
 }
@@ -23,13 +23,33 @@
 #include <sys/time.h>
 
 #include "list.h"
+#include "realtime.h"
 #include "state.h"
 
 #define PCS_DEFAULT_REGS_COUNT	512
+#define PCS_MAX_THREADS		64
+
+struct io_options {
+	char			*backend;
+	char			*file;
+	char			*capture;
+	char			*root;
+	char			*inventory;
+};
 
 struct server_config {
 	long			multiple;
+	int			stagger;
+	int			threads;
+	int			async_input;
+	int			sync_analog;
+	struct io_options	io;
+	unsigned int		sim_slot;
+	struct realtime_options	realtime;
+	char			*recorder_path;
+	unsigned int		recorder_depth;
 	struct list_head	block_list;
+	struct list_head	pending_list;
 	int			regs_count;
 	int			regs_used;
 	long			*regs;
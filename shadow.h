@@ -0,0 +1,64 @@
+/* shadow.h -- suppress writes of unchanged output values
+ * Copyright (C) 2014 Sergei Ianovich <ynvich@gmail.com>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 2 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public
+ * License along with this program; if not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+ * Boston, MA 02111-1307, USA.
+ */
+
+#ifndef _PCS_SHADOW_H
+#define _PCS_SHADOW_H
+
+/* Default number of runs between forced writes of an unchanged value */
+#define PCS_SHADOW_REFRESH	100
+
+struct shadow {
+	unsigned int		refresh;
+	unsigned int		counter;
+	int			valid;
+	unsigned long		value;
+};
+
+static inline void
+shadow_init(struct shadow *sh, unsigned int refresh)
+{
+	sh->refresh = refresh;
+	sh->valid = 0;
+}
+
+/*
+ * Returns 1 when value has to be written: it differs from the last one
+ * written, or refresh runs passed since then. Zero refresh never forces
+ * a write.
+ */
+static inline int
+shadow_update(struct shadow *sh, unsigned long value)
+{
+	if (sh->valid && sh->value == value) {
+		if (!sh->refresh || --sh->counter)
+			return 0;
+	}
+	sh->value = value;
+	sh->valid = 1;
+	sh->counter = sh->refresh;
+	return 1;
+}
+
+/* The write failed or the hardware was reset, write again next time */
+static inline void
+shadow_invalidate(struct shadow *sh)
+{
+	sh->valid = 0;
+}
+#endif
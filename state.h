@@ -21,9 +21,44 @@
 #define _PCS_STATE_H
 
 #include <sys/time.h>
+#include <time.h>
+
+#define PCS_OVERRUN_CATCH_UP	0
+#define PCS_OVERRUN_SKIP	1
+#define PCS_OVERRUN_SHED	2
+/* Late ticks in a row run back to back before the rest are skipped */
+#define PCS_OVERRUN_BURST	4
+
+#ifdef PCS_PROFILE
+#define PCS_PROFILE_BUCKETS	32
+
+/* Execution times in nanoseconds, hist[i] counts times in [2^i, 2^(i+1)) */
+struct profile {
+	unsigned long		count;
+	unsigned long		min;
+	unsigned long		max;
+	unsigned long long	total;
+	unsigned long		hist[PCS_PROFILE_BUCKETS];
+};
+#endif
 
 struct server_state {
 	struct timeval		start;
 	struct timeval		tick;
+	struct timespec		deadline;
+	long			latency;
+	long			max_latency;
+	unsigned long long	total_latency;
+	unsigned long		wakeups;
+	int			overrun;
+	int			late;
+	unsigned int		burst;
+	unsigned int		late_ticks;
+	unsigned long		overruns;
+	unsigned long		ticks_lost;
+	unsigned long		shed;
+#ifdef PCS_PROFILE
+	struct profile		tick_profile;
+#endif
 };
 #endif
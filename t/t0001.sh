@@ -1,8 +1,15 @@
 #/bin/sh
 SELF=`basename $0`
-./pcs -tf t/$SELF.conf &&
-coproc ./pcs -Df t/$SELF.conf 2>/tmp/$SELF.log &&
-sleep 0.15 &&
-kill $COPROC_PID &&
-test 2 -eq `grep -e "mark1:1 mark2:1" /tmp/$SELF.log | wc -l` &&
-test 2 -eq `cat /tmp/$SELF.log | wc -l`
+LOG=/tmp/$SELF.log
+
+./pcs -tf t/$SELF.conf || exit 1
+
+./pcs -Df t/$SELF.conf 2>$LOG &
+PCS=$!
+for i in `seq 100`; do
+	test 2 -le `cat $LOG | wc -l` && break
+	sleep 0.05
+done
+kill $PCS
+wait $PCS
+test 2 -eq `sed -n 1,2p $LOG | grep -e "mark1:1 mark2:1" | wc -l`
@@ -1,9 +1,18 @@
 #/bin/sh
 SELF=`basename $0`
-./pcs -tf t/$SELF.conf &&
-coproc ./pcs -Df t/$SELF.conf 2>/tmp/$SELF.log &&
-sleep 0.14 &&
-kill $COPROC_PID &&
-test 2 -eq `grep -e "mark1:1 mark2:1" /tmp/$SELF.log | wc -l` &&
-test 3 -eq `grep -e "mark3:1" /tmp/$SELF.log | wc -l` &&
-test 5 -eq `cat /tmp/$SELF.log | wc -l`
+LOG=/tmp/$SELF.log
+
+./pcs -tf t/$SELF.conf || exit 1
+
+./pcs -Df t/$SELF.conf 2>$LOG &
+PCS=$!
+for i in `seq 100`; do
+	test 5 -le `cat $LOG | wc -l` && break
+	sleep 0.05
+done
+kill $PCS
+wait $PCS
+# Three ticks: the group with multiple 2 runs on the first and third
+sed -n 1,5p $LOG > /tmp/$SELF.head &&
+test 2 -eq `grep -e "mark1:1 mark2:1" /tmp/$SELF.head | wc -l` &&
+test 3 -eq `grep -e "mark3:1" /tmp/$SELF.head | wc -l`
@@ -0,0 +1,27 @@
+#/bin/sh
+SELF=`basename $0`
+LOG=/tmp/$SELF.log
+
+# Waits up to 5 seconds for the log block to print $1 lines
+wait_marks() {
+	for i in `seq 100`; do
+		test $1 -le `grep -c "^mark1:1 $" $LOG` && return 0
+		sleep 0.05
+	done
+	return 1
+}
+
+./pcs -tf t/$SELF.conf || exit 1
+./pcs -Ddf t/$SELF.conf 2>$LOG &
+PCS=$!
+wait_marks 2 &&
+kill -STOP $PCS &&
+sleep 0.6 &&
+kill -CONT $PCS &&
+N=`grep -c "^mark1:1 $" $LOG` &&
+wait_marks $((N + 2))
+ERR=$?
+kill $PCS
+wait $PCS
+test 0 -eq $ERR &&
+grep -q "^[1-9][0-9]* overruns, [1-9][0-9]* ticks lost, [1-9][0-9]* block runs shed$" $LOG
@@ -0,0 +1,18 @@
+#/bin/sh
+SELF=`basename $0`
+LOG=/tmp/$SELF.log
+
+./pcs -tf t/$SELF.conf || exit 1
+sed -e "s/phase: 0/phase: 2/" t/$SELF.conf > /tmp/$SELF.conf &&
+./pcs -tf /tmp/$SELF.conf 2>/dev/null && exit 1
+
+./pcs -Df t/$SELF.conf 2>$LOG &
+PCS=$!
+for i in `seq 100`; do
+	test 4 -le `cat $LOG | wc -l` && break
+	sleep 0.05
+done
+kill $PCS
+wait $PCS
+printf "mark3:1 \nmark1:1 \nmark2:1 \nmark3:1 \n" > /tmp/$SELF.expected &&
+sed -n 1,4p $LOG | cmp -s - /tmp/$SELF.expected
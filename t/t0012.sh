@@ -0,0 +1,18 @@
+#/bin/sh
+SELF=`basename $0`
+LOG=/tmp/$SELF.log
+
+./pcs -tf t/$SELF.conf || exit 1
+
+./pcs -Df t/$SELF.conf 2>$LOG &
+PCS=$!
+for i in `seq 100`; do
+	test 4 -le `cat $LOG | wc -l` && break
+	sleep 0.05
+done
+kill $PCS
+wait $PCS
+test 1 -eq `grep -e "feedback loop" $LOG | wc -l` &&
+test "mark1:1 valve:1 fb:1 " = "`sed -n 2p $LOG`" &&
+test "mark1:1 valve:2 fb:2 " = "`sed -n 3p $LOG`" &&
+test "mark1:1 valve:3 fb:3 " = "`sed -n 4p $LOG`"
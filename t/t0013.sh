@@ -0,0 +1,26 @@
+#/bin/sh
+SELF=`basename $0`
+LOG=/tmp/$SELF.log
+
+./pcs -tf t/$SELF.conf || exit 1
+
+./pcs -Ddf t/$SELF.conf 2>$LOG &
+PCS=$!
+for i in `seq 100`; do
+	test 3 -le `grep -c "^a0:" $LOG` && break
+	sleep 0.05
+done
+# Input block stats are dumped by the I/O thread
+if grep -q "define PCS_PROFILE" config.h; then
+	kill -USR1 $PCS
+	for i in `seq 100`; do
+		grep -q "^ai: [0-9]* runs" $LOG && break
+		sleep 0.05
+	done
+	grep -q "^ai: [0-9]* runs" $LOG || FAIL=1
+fi
+kill $PCS
+wait $PCS
+test -z "$FAIL" &&
+grep -q "2 input blocks acquired asynchronously" $LOG &&
+test "a0:1234 a1:-250 d0:1 d2:1 " = "`grep "^a0:" $LOG | sed -n 3p`"
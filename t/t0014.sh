@@ -0,0 +1,22 @@
+#/bin/sh
+SELF=`basename $0`
+LOG=/tmp/$SELF.log
+
+./pcs -tf t/$SELF.conf || exit 1
+
+./tick-bench -m -c 0 -n 200 -i 1000 > /tmp/$SELF.bench 2>&1 &&
+grep -q "^200 wake-ups" /tmp/$SELF.bench &&
+grep -q "^latency usec: p50 [0-9]*, p90" /tmp/$SELF.bench || exit 1
+
+./pcs -Ddf t/$SELF.conf 2>$LOG &
+PCS=$!
+for i in `seq 100`; do
+	test 3 -le `grep -c "^mark1:1" $LOG` && break
+	sleep 0.05
+done
+kill $PCS
+wait $PCS
+grep -q "real-time profile: priority 50, cpu 0, 128 kB stack" $LOG &&
+grep -q "^max wake-up latency" $LOG &&
+test 3 -le `grep -c "^mark1:1" $LOG` &&
+! grep -q "heap allocation" $LOG
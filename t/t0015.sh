@@ -0,0 +1,25 @@
+#/bin/sh
+SELF=`basename $0`
+LOG=/tmp/$SELF.log
+
+grep -q "define PCS_PROFILE" config.h || exit 77
+./pcs -tf t/$SELF.conf || exit 1
+
+./pcs -Df t/$SELF.conf 2>$LOG &
+PCS=$!
+for i in `seq 100`; do
+	test 4 -le `grep -c "^mark1:1" $LOG` && break
+	sleep 0.05
+done
+kill -USR1 $PCS
+for i in `seq 100`; do
+	grep -q "^#1: [0-9]* runs" $LOG && break
+	sleep 0.05
+done
+kill $PCS
+wait $PCS
+# Every block runs once per tick, up to the tick the dump follows
+RUNS=`sed -n "s/^tick: \([0-9]*\) runs.*/\1/p" $LOG`
+test -n "$RUNS" && test 4 -le $RUNS &&
+grep -q -e "^c1: $RUNS runs" $LOG &&
+grep -q -e "^#1: $RUNS runs" $LOG
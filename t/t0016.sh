@@ -0,0 +1,36 @@
+#/bin/sh
+SELF=`basename $0`
+LOG=/tmp/$SELF.log
+REC=/tmp/$SELF.rec
+
+./pcs -tf t/$SELF.conf || exit 1
+
+# Runs pcs until it logs three ticks
+run_pcs() {
+	./pcs -Df t/$SELF.conf 2>$LOG &
+	PCS=$!
+	for i in `seq 100`; do
+		test 3 -le `cat $LOG | wc -l` && break
+		sleep 0.05
+	done
+	kill $PCS
+	wait $PCS
+}
+
+# The ring keeps the last two of them
+check_ring() {
+	./pcs-recorder -f t/$SELF.conf $1 > /tmp/$SELF.csv &&
+	test "time,c1.1,c1.2" = "`sed -n 1p /tmp/$SELF.csv`" &&
+	test 3 -eq `cat /tmp/$SELF.csv | wc -l` &&
+	test 2 -eq `grep -e ",1,7$" /tmp/$SELF.csv | wc -l`
+}
+
+rm -f $REC $REC.1
+run_pcs
+check_ring $REC || exit 1
+cp $REC /tmp/$SELF.first
+
+# A restart keeps the previous ring
+run_pcs
+check_ring $REC &&
+cmp -s $REC.1 /tmp/$SELF.first
@@ -0,0 +1,3 @@
+#/bin/sh
+SELF=`basename $0`
+./pcs -tf t/$SELF.conf
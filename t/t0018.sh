@@ -0,0 +1,25 @@
+#/bin/sh
+SELF=`basename $0`
+LOG=/tmp/$SELF.log
+
+./pcs -tf t/$SELF.conf || exit 1
+
+# Runs pcs with the config in $1 until it logs two ticks
+run_pcs() {
+	./pcs -Df $1 2>$2 &
+	PCS=$!
+	for i in `seq 100`; do
+		test 2 -le `cat $2 | wc -l` && break
+		sleep 0.05
+	done
+	kill $PCS
+	wait $PCS
+}
+
+run_pcs t/$SELF.conf $LOG
+test "a0:1234 a1:-250 d0:1 d2:1 " = "`sed -n 1p $LOG`" || exit 1
+
+sed -e "s/backend : simulator/backend : replay/" -e "s/capture :/file :/" \
+	t/$SELF.conf > /tmp/$SELF.conf &&
+run_pcs /tmp/$SELF.conf /tmp/$SELF.replay.log &&
+test "a0:1234 a1:-250 d0:1 d2:1 " = "`sed -n 1p /tmp/$SELF.replay.log`"
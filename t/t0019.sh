@@ -0,0 +1,9 @@
+#/bin/sh
+SELF=`basename $0`
+ROOT=/tmp/$SELF.root
+coproc ./dcon-emu -r $ROOT 1:i-87017 2:i-87040 &&
+read PTY <&${COPROC[0]} &&
+./dcon-bench -n 200 -p $PTY -r $ROOT 1 2
+ERR=$?
+kill $COPROC_PID
+exit $ERR
@@ -0,0 +1,21 @@
+#/bin/sh
+SELF=`basename $0`
+./pcs -tf t/$SELF.conf &&
+coproc ./modbus-sim -d -p 0 2>/tmp/$SELF.sim.log &&
+read PORT <&${COPROC[0]} &&
+SIM=$COPROC_PID &&
+sed -e "s|DEVICE|127.0.0.1:$PORT|" t/$SELF.conf > /tmp/$SELF.conf &&
+{ ./pcs -Df /tmp/$SELF.conf 2>/tmp/$SELF.log & } &&
+PCS=$! &&
+for i in `seq 100`; do
+	grep -q "a:100 b:103 c:105 d:-5 " /tmp/$SELF.log && break
+	sleep 0.05
+done &&
+kill $PCS &&
+wait $PCS &&
+grep -q "a:100 b:103 c:105 d:-5 " /tmp/$SELF.log &&
+grep -q "address 100 count 6" /tmp/$SELF.sim.log &&
+! grep -q "address 104" /tmp/$SELF.sim.log
+ERR=$?
+kill $SIM
+exit $ERR
@@ -0,0 +1,15 @@
+#/bin/sh
+SELF=`basename $0`
+INV=/tmp/$SELF.inventory
+rm -f $INV &&
+./pcs -tf t/$SELF.conf &&
+printf "slots 3\n2 87017\n3 8042\n" | cmp - $INV &&
+sed -e "s/slot : 3/slot : 2/" t/$SELF.conf > /tmp/$SELF.conf &&
+! ./pcs -tf /tmp/$SELF.conf 2>/dev/null &&
+printf "slots 3\n2 87017\n3 8042\n" | cmp - $INV &&
+# A module swapped since the cache was written is probed again
+printf "slots 3\n2 87017\n3 8041\n" > $INV &&
+./pcs -tf t/$SELF.conf &&
+printf "slots 3\n2 87017\n3 8042\n" | cmp - $INV &&
+printf "slots 4\n2 87017\n3 8041\n" > $INV &&
+./pcs -tf t/$SELF.conf
@@ -0,0 +1,17 @@
+#/bin/sh
+SELF=`basename $0`
+ROOT=/tmp/$SELF.root
+coproc ./dcon-emu -r $ROOT 1:i-87017 2:i-87040 &&
+read PTY <&${COPROC[0]} &&
+printf "1:\$00M\n#00 50\n\n2:@00 10\n" > /tmp/$SELF.cmd &&
+./dcon-raw -p $PTY -r $ROOT -s 1 -f /tmp/$SELF.cmd > /tmp/$SELF.log &&
+grep -q "^1:\$00M x1: 0 errors, .*usec$" /tmp/$SELF.log &&
+grep -q "^  !0087017$" /tmp/$SELF.log &&
+grep -q "^1:#00 x50: 0 errors" /tmp/$SELF.log &&
+grep -q "^2:@00 x10: 0 errors" /tmp/$SELF.log &&
+grep -q "^total 61 exchanges, 0 errors" /tmp/$SELF.log &&
+grep -q " usec |#" /tmp/$SELF.log &&
+echo "2:@00" | ./dcon-raw -p $PTY -r $ROOT -n 3 -b | grep -q "^2:@00 x3: 0 errors"
+ERR=$?
+kill $COPROC_PID
+exit $ERR
@@ -0,0 +1,21 @@
+#/bin/sh
+SELF=`basename $0`
+OUT=/tmp/$SELF.output
+
+# Modules are probed before pcs daemonizes, with no inventory to go by
+rm -f /tmp/$SELF.inventory &&
+: > $OUT &&
+./pcs -f t/$SELF.conf 2>/dev/null || exit 1
+for i in `seq 100`; do
+	test 3 -le `cat $OUT | wc -l` && break
+	sleep 0.05
+done
+pkill -f "pcs -f t/$SELF.conf"
+for i in `seq 100`; do
+	pgrep -f "pcs -f t/$SELF.conf" > /dev/null || break
+	sleep 0.05
+done
+! pgrep -f "pcs -f t/$SELF.conf" > /dev/null &&
+test -f /tmp/$SELF.inventory &&
+test 3 -le `cat $OUT | wc -l` &&
+test '{"a0":1234}' = "`sed -n 3p $OUT`"
@@ -0,0 +1,95 @@
+/* t/t2020.c -- test i-8041 output blocks sharing a slot
+ * Copyright (C) 2014 Sergey Yanovich <ynvich@gmail.com>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 2 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public
+ * License along with this program; if not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+ * Boston, MA 02111-1307, USA.
+ */
+
+#include "includes.h"
+
+#include "block.h"
+#include "i-8041.h"
+#include "icpdas.h"
+#include "map.h"
+#include "state.h"
+
+#define SLOT	2
+
+static struct block *
+out_block(const char *key, long *input)
+{
+	struct block_builder *bb = load_i_8041_builder();
+	struct block *b;
+	void (*set_input)(void *, const char const *, long *);
+	int (*setter)(void *, const char const *, long);
+
+	b = xzalloc(sizeof(*b));
+	b->data = bb->alloc();
+	set_input = pcs_lookup(bb->inputs, key);
+	if (NULL == set_input)
+		fatal(__FILE__ ": bad 'i-8041' input key\n");
+	set_input(b->data, key, input);
+	setter = pcs_lookup(bb->setpoints, "slot");
+	if (!setter)
+		fatal(__FILE__ ": bad 'i-8041' setpoint 'slot'\n");
+	setter(b->data, "slot", SLOT);
+	b->ops = bb->ops(b);
+	if (!b->ops || !b->ops->run)
+		fatal(__FILE__ ": bad 'i-8041' ops\n");
+	return b;
+}
+
+static void
+tick(struct block *a, struct block *b, struct server_state *s,
+		unsigned long expected)
+{
+	unsigned long out;
+
+	a->ops->run(a, s);
+	b->ops->run(b, s);
+	icpdas_commit_outputs();
+	if (0 > icpdas_get_parallel_output(SLOT, &out))
+		fatal(__FILE__ ": no output on slot %u\n", SLOT);
+	if (out != expected)
+		fatal(__FILE__ ": bad output 0x%08lx instead of 0x%08lx\n",
+				out, expected);
+}
+
+int main(int argc, char **argv)
+{
+	struct server_state s;
+	struct block *a, *b;
+	long in0 = 0, in1 = 0;
+
+	log_init(__FILE__, LOG_DEBUG + 2, LOG_DAEMON, 1);
+	if (icpdas_io_setup("simulator", NULL, NULL) ||
+			icpdas_sim_set_model(SLOT, "i-8041"))
+		fatal(__FILE__ ": no simulated i-8041\n");
+	/* A bit neither block drives */
+	icpdas_set_parallel_output(SLOT, 0x80000000);
+
+	a = out_block("0", &in0);
+	b = out_block("1", &in1);
+
+	in0 = 1;
+	tick(a, b, &s, 0x80000001);
+	/* Only the second block writes, the first one keeps its bit */
+	in1 = 1;
+	tick(a, b, &s, 0x80000003);
+	in0 = 0;
+	in1 = 0;
+	tick(a, b, &s, 0x80000000);
+	return 0;
+}
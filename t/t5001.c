@@ -0,0 +1,72 @@
+/* t/t5001.c -- test multi-rate scheduler
+ * Copyright (C) 2014 Sergei Ianovich <ynvich@gmail.com>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 2 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public
+ * License along with this program; if not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+ * Boston, MA 02111-1307, USA.
+ */
+
+#include "includes.h"
+
+#include "block.h"
+#include "list.h"
+#include "scheduler.h"
+
+#define BLOCKS	7
+#define TICKS	120
+
+static const unsigned int multiples[BLOCKS] = { 1, 3, 2, 1, 5, 3, 2 };
+
+int main(int argc, char **argv)
+{
+	struct block blocks[BLOCKS];
+	struct scheduler sched;
+	struct block **run;
+	unsigned int counter[BLOCKS];
+	unsigned int expected[BLOCKS];
+	unsigned int i, j, n, tick;
+	LIST_HEAD(block_list);
+
+	for (i = 0; i < BLOCKS; i++) {
+		blocks[i].multiple = multiples[i];
+		blocks[i].counter = 1;
+		counter[i] = 1;
+		list_add_tail(&blocks[i].block_entry, &block_list);
+	}
+
+	scheduler_init(&sched, &block_list);
+	if (4 != sched.groups_count)
+		fatal("t5001: bad group count %u\n", sched.groups_count);
+
+	for (tick = 0; tick < TICKS; tick++) {
+		j = 0;
+		for (i = 0; i < BLOCKS; i++) {
+			if (--counter[i])
+				continue;
+			counter[i] = multiples[i];
+			expected[j++] = i;
+		}
+
+		n = scheduler_next(&sched, &run);
+		if (n != j)
+			fatal("t5001: tick %u: %u blocks due instead of %u\n",
+					tick, n, j);
+		for (i = 0; i < n; i++)
+			if (run[i] != &blocks[expected[i]])
+				fatal("t5001: tick %u: bad block %u at %u\n",
+						tick, run[i]->index, i);
+	}
+
+	return 0;
+}
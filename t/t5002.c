@@ -0,0 +1,195 @@
+/* t/t5002.c -- test parallel block execution
+ * Copyright (C) 2014 Sergei Ianovich <ynvich@gmail.com>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 2 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public
+ * License along with this program; if not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+ * Boston, MA 02111-1307, USA.
+ */
+
+#include "includes.h"
+
+#include <string.h>
+
+#include "block.h"
+#include "block_builder.h"
+#include "list.h"
+#include "parallel.h"
+#include "scheduler.h"
+#include "state.h"
+
+#define BLOCKS	200
+#define TICKS	50
+
+static struct block_builder io_builder = {
+	.flags		= PCS_BLOCK_IO,
+};
+
+/* Like copy, writes its result to the register of its first input */
+static struct block_builder copy_builder = {
+	.flags		= PCS_BLOCK_WRITES_INPUTS,
+};
+
+static unsigned int trace[BLOCKS * TICKS];
+static unsigned int trace_count;
+
+static void
+test_run(struct block *b, struct server_state *s)
+{
+	long v = b->outputs[0] * 7 + b->index;
+	unsigned int i;
+
+	for (i = 0; i < b->deps_count; i++)
+		v = (v * 31 + b->deps[i]->outputs[0]) % 1000003;
+	b->outputs[0] = v;
+	if (&copy_builder == b->builder)
+		b->deps[0]->outputs[0] = v;
+	else if (b->builder)
+		trace[trace_count++] = b->index;
+}
+
+static struct block_ops ops = {
+	.run		= test_run,
+};
+
+static void
+setup(struct block *blocks, long *regs, struct list_head *block_list)
+{
+	unsigned int i, j;
+
+	srand(2001);
+	for (i = 0; i < BLOCKS; i++) {
+		struct block *b = &blocks[i];
+		memset(b, 0, sizeof(*b));
+		b->ops = &ops;
+		b->multiple = 1 + rand() % 3;
+		b->counter = 1;
+		b->outputs = &regs[i];
+		if (0 == rand() % 10)
+			b->builder = &io_builder;
+		b->deps_count = rand() % 4;
+		if (b->deps_count)
+			b->deps = xcalloc(b->deps_count, sizeof(*b->deps));
+		for (j = 0; j < b->deps_count; j++)
+			b->deps[j] = &blocks[rand() % BLOCKS];
+		if (b->deps_count && !b->builder && 0 == rand() % 20)
+			b->builder = &copy_builder;
+		list_add_tail(&b->block_entry, block_list);
+	}
+}
+
+/*
+ * Inputs published by another list, such as the I/O stage, carry
+ * indices of that list and must not order blocks of this one.
+ */
+static void
+foreign_inputs(struct server_state *s)
+{
+	static struct block blocks[2], io[2];
+	static long regs[4];
+	struct block *deps[2] = { &io[0], &io[1] };
+	struct scheduler sched;
+	struct parallel_pool *pool;
+	unsigned int i;
+	LIST_HEAD(io_list);
+	LIST_HEAD(block_list);
+
+	for (i = 0; i < 2; i++) {
+		io[i].ops = &ops;
+		io[i].multiple = 1;
+		io[i].outputs = &regs[i];
+		list_add_tail(&io[i].block_entry, &io_list);
+		blocks[i].ops = &ops;
+		blocks[i].multiple = 1;
+		blocks[i].outputs = &regs[2 + i];
+		list_add_tail(&blocks[i].block_entry, &block_list);
+	}
+	blocks[1].deps = deps;
+	blocks[1].deps_count = 2;
+	scheduler_init(&sched, &io_list);
+	io[0].level = 7;
+	io[1].index = 5;
+	scheduler_init(&sched, &block_list);
+	pool = parallel_init(&block_list, 2);
+	if (!pool)
+		fatal("t5002: no thread pool\n");
+	for (i = 0; i < 2; i++)
+		if (blocks[i].level != 0)
+			fatal("t5002: block %u at level %u after foreign "
+					"inputs\n", i, blocks[i].level);
+	parallel_stop(pool);
+}
+
+int main(int argc, char **argv)
+{
+	static struct block seq[BLOCKS], par[BLOCKS];
+	static long seq_regs[BLOCKS], par_regs[BLOCKS];
+	static unsigned int seq_trace[BLOCKS * TICKS];
+	unsigned int seq_count;
+	struct server_state s = {
+	};
+	struct scheduler sched;
+	struct parallel_pool *pool;
+	struct block **run;
+	unsigned int i, n, tick;
+	LIST_HEAD(seq_list);
+	LIST_HEAD(par_list);
+
+	setup(seq, seq_regs, &seq_list);
+	scheduler_init(&sched, &seq_list);
+	for (tick = 0; tick < TICKS; tick++) {
+		n = scheduler_next(&sched, &run);
+		for (i = 0; i < n; i++)
+			run[i]->ops->run(run[i], &s);
+	}
+	seq_count = trace_count;
+	memcpy(seq_trace, trace, sizeof(trace));
+	trace_count = 0;
+
+	setup(par, par_regs, &par_list);
+	scheduler_init(&sched, &par_list);
+	pool = parallel_init(&par_list, 4);
+	if (!pool)
+		fatal("t5002: no thread pool\n");
+	/* A block writing its inputs must run alone in its level */
+	for (i = 0; i < BLOCKS; i++) {
+		if (&copy_builder != par[i].builder)
+			continue;
+		for (n = 0; n < BLOCKS; n++)
+			if (n < i ? par[n].level >= par[i].level :
+					n > i && par[n].level <= par[i].level)
+				fatal("t5002: block %u at level %u runs with "
+						"copy block %u\n", n,
+						par[n].level, i);
+	}
+	for (tick = 0; tick < TICKS; tick++) {
+		n = scheduler_next(&sched, &run);
+		parallel_run(pool, run, n, &s);
+	}
+	parallel_stop(pool);
+
+	for (i = 0; i < BLOCKS; i++)
+		if (seq_regs[i] != par_regs[i])
+			fatal("t5002: block %u: %li instead of %li\n", i,
+					par_regs[i], seq_regs[i]);
+	if (seq_count != trace_count)
+		fatal("t5002: %u I/O runs instead of %u\n", trace_count,
+				seq_count);
+	for (i = 0; i < seq_count; i++)
+		if (seq_trace[i] != trace[i])
+			fatal("t5002: I/O run %u is block %u instead of %u\n",
+					i, trace[i], seq_trace[i]);
+
+	foreign_inputs(&s);
+	return 0;
+}
@@ -0,0 +1,50 @@
+/* t/t5003.c -- test output write suppression
+ * Copyright (C) 2014 Sergei Ianovich <ynvich@gmail.com>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 2 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public
+ * License along with this program; if not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+ * Boston, MA 02111-1307, USA.
+ */
+
+#include "includes.h"
+
+#include "shadow.h"
+
+int main(int argc, char **argv)
+{
+	struct shadow sh;
+	int i, writes = 0;
+
+	shadow_init(&sh, 3);
+	if (!shadow_update(&sh, 5))
+		fatal("t5003: first value not written\n");
+	for (i = 0; i < 6; i++)
+		writes += shadow_update(&sh, 5);
+	if (2 != writes)
+		fatal("t5003: %i refresh writes instead of 2\n", writes);
+	if (!shadow_update(&sh, 6))
+		fatal("t5003: changed value not written\n");
+	if (shadow_update(&sh, 6))
+		fatal("t5003: unchanged value written\n");
+	shadow_invalidate(&sh);
+	if (!shadow_update(&sh, 6))
+		fatal("t5003: invalidated value not written\n");
+
+	shadow_init(&sh, 0);
+	shadow_update(&sh, 1);
+	for (i = 0; i < 1000; i++)
+		if (shadow_update(&sh, 1))
+			fatal("t5003: write without refresh\n");
+	return 0;
+}
@@ -0,0 +1,71 @@
+/* t/t5003.c -- test output write suppression
+ * Copyright (C) 2014 Sergei Ianovich <ynvich@gmail.com>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 2 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public
+ * License along with this program; if not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+ * Boston, MA 02111-1307, USA.
+ */
+
+#include "includes.h"
+
+#include "modbus.h"
+
+static struct modbus_read reads[] = {
+	{ .unit = 1, .function = 4, .address = 100, .count = 4, },
+	{ .unit = 1, .function = 4, .address = 104, .count = 4, },
+	{ .unit = 1, .function = 4, .address = 102, .count = 2, },
+	{ .unit = 1, .function = 4, .address = 110, .count = 2, },
+	{ .unit = 1, .function = 3, .address = 100, .count = 2, },
+	{ .unit = 2, .function = 4, .address = 100, .count = 1, },
+	{ .unit = 1, .function = 4, .address = 200, .count = 100, },
+	{ .unit = 1, .function = 4, .address = 300, .count = 100, },
+};
+
+int main(int argc, char **argv)
+{
+	const unsigned char request[] = { 1, 3, 0, 0, 0, 10 };
+	struct modbus_read bad = {
+		.unit = 1, .function = 4, .address = 0, .count = 126,
+	};
+	struct modbus_read rtu = {
+		.unit = 1, .function = 3, .address = 0, .count = 1,
+	};
+	unsigned int i;
+	int frames;
+
+	if (0xcdc5 != modbus_crc16(request, sizeof(request)))
+		fatal("t5004: bad CRC %04x\n",
+				modbus_crc16(request, sizeof(request)));
+
+	for (i = 0; i < sizeof(reads) / sizeof(reads[0]); i++)
+		if (modbus_attach("localhost:1502", MODBUS_BAUD_RATE, &reads[i]))
+			fatal("t5004: read %u not attached\n", i);
+	if (!modbus_attach("localhost:1502", MODBUS_BAUD_RATE, &bad))
+		fatal("t5004: read of %u registers attached\n", bad.count);
+	if (modbus_attach("/dev/ttyS2", 9600, &rtu))
+		fatal("t5004: rtu read not attached\n");
+	if (!modbus_attach("/dev/ttyS2", 19200, &bad))
+		fatal("t5004: baud rate conflict not detected\n");
+
+	frames = modbus_plan();
+	if (7 != frames)
+		fatal("t5004: %i frames instead of 7\n", frames);
+	if (reads[0].frame != reads[1].frame ||
+			reads[0].frame != reads[2].frame)
+		fatal("t5004: contiguous reads not merged\n");
+	for (i = 3; i < sizeof(reads) / sizeof(reads[0]); i++)
+		if (reads[i].frame == reads[i - 1].frame)
+			fatal("t5004: read %u merged\n", i);
+	return 0;
+}
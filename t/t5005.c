@@ -0,0 +1,93 @@
+/* t/t5005.c -- test commit of staged outputs
+ * Copyright (C) 2014 Sergey Yanovich <ynvich@gmail.com>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 2 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public
+ * License along with this program; if not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+ * Boston, MA 02111-1307, USA.
+ */
+
+#include "includes.h"
+
+#include "icpdas.h"
+#include "shadow.h"
+
+#define DIGITAL	2
+#define ANALOG	3
+/* Nothing is simulated there, so every write fails */
+#define EMPTY	5
+
+static void
+check_writes(unsigned int slot, unsigned long expected)
+{
+	unsigned long writes = icpdas_sim_writes(slot);
+
+	if (writes != expected)
+		fatal("t5005: %lu writes to slot %u instead of %lu\n",
+				writes, slot, expected);
+}
+
+int main(int argc, char **argv)
+{
+	struct shadow a, b, c, d;
+	unsigned long out;
+	int tick;
+
+	log_init(__FILE__, LOG_DEBUG + 2, LOG_DAEMON, 1);
+	if (icpdas_io_setup("simulator", NULL, NULL) ||
+			icpdas_sim_set_model(DIGITAL, "i-8041") ||
+			icpdas_sim_set_model(ANALOG, "i-8024"))
+		fatal("t5005: no simulated modules\n");
+
+	/* Stagings of a tick reach the module in one write per output */
+	for (tick = 1; tick <= 3; tick++) {
+		icpdas_stage_parallel_output(DIGITAL, tick, 0xffff, NULL);
+		icpdas_stage_parallel_output(DIGITAL, tick << 16,
+				0xffff0000, NULL);
+		icpdas_stage_parallel_analog_output(ANALOG, 0, tick, NULL);
+		icpdas_stage_parallel_analog_output(ANALOG, 1, -tick, NULL);
+		icpdas_stage_parallel_analog_output(ANALOG, 1, tick, NULL);
+		icpdas_commit_outputs();
+		check_writes(DIGITAL, tick);
+		check_writes(ANALOG, 2 * tick);
+		icpdas_get_parallel_output(DIGITAL, &out);
+		if (out != (tick | (tick << 16)))
+			fatal("t5005: output 0x%08lx on tick %i\n", out, tick);
+	}
+
+	/* Nothing staged, nothing written */
+	icpdas_commit_outputs();
+	check_writes(DIGITAL, 3);
+	check_writes(ANALOG, 6);
+
+	/* A failed write makes every block which staged it write again */
+	shadow_init(&a, 0);
+	shadow_init(&b, 0);
+	shadow_init(&c, 0);
+	shadow_init(&d, 0);
+	shadow_update(&a, 1);
+	shadow_update(&b, 2);
+	shadow_update(&c, 3);
+	shadow_update(&d, 4);
+	icpdas_stage_parallel_output(EMPTY, 1, 0xffff, &a);
+	icpdas_stage_parallel_output(EMPTY, 2 << 16, 0xffff0000, &b);
+	icpdas_stage_parallel_analog_output(EMPTY, 0, 3, &c);
+	icpdas_stage_parallel_output(DIGITAL, 4, 0xffffffff, &d);
+	icpdas_commit_outputs();
+	if (!shadow_update(&a, 1) || !shadow_update(&b, 2) ||
+			!shadow_update(&c, 3))
+		fatal("t5005: shadow kept after a failed write\n");
+	if (shadow_update(&d, 4))
+		fatal("t5005: shadow lost after a good write\n");
+	return 0;
+}
@@ -0,0 +1,69 @@
+/* t/t5006.c -- test synchronized sampling triggers
+ * Copyright (C) 2014 Sergey Yanovich <ynvich@gmail.com>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 2 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public
+ * License along with this program; if not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+ * Boston, MA 02111-1307, USA.
+ */
+
+#include "includes.h"
+
+#include <string.h>
+
+#include "icpdas.h"
+
+#define DEVICE	"/dev/ttyS1"
+
+/* The simulated module answers $AA4 with >AA1 after a trigger */
+static void
+check_latched(unsigned int slot, int latched)
+{
+	char data[128];
+
+	if (0 > icpdas_serial_exchange(DEVICE, slot, "$004", sizeof(data),
+				data))
+		fatal("t5006: no reply from slot %u\n", slot);
+	if (strncmp(data, latched ? ">001" : ">000", 4))
+		fatal("t5006: slot %u %s a trigger: %s\n", slot,
+				latched ? "missed" : "got", data);
+}
+
+int main(int argc, char **argv)
+{
+	log_init(__FILE__, LOG_DEBUG + 2, LOG_DAEMON, 1);
+	if (icpdas_io_setup("simulator", NULL, NULL) ||
+			icpdas_sim_set_model(2, "i-87017") ||
+			icpdas_sim_set_model(3, "i-87017"))
+		fatal("t5006: no simulated modules\n");
+	icpdas_serial_attach(DEVICE, 2, 1);
+	icpdas_serial_attach(DEVICE, 3, 1);
+	icpdas_serial_sync_mode(1);
+
+	/* Only the slot read this tick is triggered */
+	icpdas_serial_sync_slot(DEVICE, 2);
+	icpdas_serial_sync();
+	check_latched(2, 1);
+	check_latched(3, 0);
+
+	/* Marks last one tick */
+	icpdas_serial_sync();
+	check_latched(2, 0);
+
+	icpdas_serial_sync_slot(DEVICE, 2);
+	icpdas_serial_sync_slot(DEVICE, 3);
+	icpdas_serial_sync();
+	check_latched(2, 1);
+	check_latched(3, 1);
+	return 0;
+}
@@ -0,0 +1,146 @@
+/* t/t5007.c -- test adaptive serial turnaround
+ * Copyright (C) 2014 Sergey Yanovich <ynvich@gmail.com>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 2 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public
+ * License along with this program; if not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+ * Boston, MA 02111-1307, USA.
+ */
+
+#include "includes.h"
+
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "icpdas.h"
+
+#define DEVICE	"/dev/ttyS1"
+#define SLOT	2
+#define STATS	"/tmp/t5007.stats"
+
+struct stats {
+	unsigned long		count;
+	unsigned long		timeouts;
+	long			p50;
+	long			p99;
+	long			turnaround;
+};
+
+static void
+read_stats(struct stats *st)
+{
+	char device[64];
+	unsigned int slot;
+	FILE *f;
+	int n;
+
+	if (icpdas_serial_save_stats(STATS))
+		fatal("t5007: stats not saved\n");
+	f = fopen(STATS, "r");
+	if (!f)
+		fatal("t5007: %s not found\n", STATS);
+	n = fscanf(f, "%63s %u %lu %lu %li %li %li", device, &slot,
+			&st->count, &st->timeouts, &st->p50, &st->p99,
+			&st->turnaround);
+	fclose(f);
+	if (7 != n || strcmp(device, DEVICE) || SLOT != slot)
+		fatal("t5007: bad stats line\n");
+}
+
+/* Sized for !AA87017, so the deadline allows the wire time exactly */
+static int
+exchange(void)
+{
+	char data[9];
+
+	return icpdas_serial_exchange(DEVICE, SLOT, "$00M", sizeof(data),
+			data);
+}
+
+static void
+replies(unsigned int count)
+{
+	unsigned int i;
+
+	for (i = 0; i < count; i++)
+		if (0 > exchange())
+			fatal("t5007: no reply %u\n", i);
+}
+
+int main(int argc, char **argv)
+{
+	struct stats st;
+	long turnaround, latency;
+
+	log_init(__FILE__, LOG_DEBUG + 2, LOG_DAEMON, 1);
+	if (icpdas_io_setup("simulator", NULL, NULL) ||
+			icpdas_sim_set_model(SLOT, "i-87017") ||
+			icpdas_sim_set_latency(SLOT, 500))
+		fatal("t5007: no simulated module\n");
+
+	/* The allowance follows twice the p99 of the replies */
+	replies(16);
+	read_stats(&st);
+	if (16 != st.count || st.timeouts)
+		fatal("t5007: %lu replies, %lu timeouts\n", st.count,
+				st.timeouts);
+	if (st.p50 < 500 || st.p99 < st.p50)
+		fatal("t5007: p50 %li, p99 %li\n", st.p50, st.p99);
+	if (st.turnaround != 2 * st.p99)
+		fatal("t5007: turnaround %li for p99 %li\n", st.turnaround,
+				st.p99);
+
+	/* A module slower than the allowance times out and doubles it */
+	turnaround = st.turnaround;
+	latency = turnaround + turnaround / 2;
+	icpdas_sim_set_latency(SLOT, latency);
+	if (0 <= exchange())
+		fatal("t5007: reply beyond the deadline\n");
+	read_stats(&st);
+	if (1 != st.timeouts || st.turnaround != 2 * turnaround)
+		fatal("t5007: turnaround %li after %lu timeouts\n",
+				st.turnaround, st.timeouts);
+
+	/* The doubled allowance fits the new latency, which then sets it */
+	replies(16);
+	read_stats(&st);
+	if (32 != st.count || 1 != st.timeouts)
+		fatal("t5007: %lu replies, %lu timeouts\n", st.count,
+				st.timeouts);
+	if (st.p50 < latency || st.turnaround != 2 * st.p99)
+		fatal("t5007: p50 %li, p99 %li, turnaround %li\n", st.p50,
+				st.p99, st.turnaround);
+
+	/* Doubling stops at 50 msec */
+	icpdas_sim_set_latency(SLOT, 100000);
+	while (st.turnaround < 50000) {
+		turnaround = st.turnaround;
+		if (0 <= exchange())
+			fatal("t5007: reply beyond the deadline\n");
+		read_stats(&st);
+		if (st.turnaround != (2 * turnaround < 50000 ?
+					2 * turnaround : 50000))
+			fatal("t5007: turnaround %li after %li\n",
+					st.turnaround, turnaround);
+	}
+	if (0 <= exchange())
+		fatal("t5007: reply beyond the deadline\n");
+	read_stats(&st);
+	if (50000 != st.turnaround)
+		fatal("t5007: turnaround %li over the limit\n",
+				st.turnaround);
+
+	unlink(STATS);
+	return 0;
+}
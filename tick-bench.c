@@ -0,0 +1,149 @@
+/* tick-bench.c -- measure tick wake-up jitter
+ * Copyright (C) 2014 Sergey Yanovich <ynvich@gmail.com>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 2 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public
+ * License along with this program; if not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+ * Boston, MA 02111-1307, USA.
+ */
+
+#include "includes.h"
+
+#include <errno.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "pcs-clock.h"
+#include "realtime.h"
+#include "serverconf.h"
+
+static void
+usage(int err)
+{
+	fprintf(stderr, "Usage: tick-bench [-dmr] [-c cpu] [-i usec] "
+			"[-n count] [-p priority]\n");
+	fprintf(stderr, "       tick-bench  -h\n");
+	exit(err);
+}
+
+static long
+parse_long(const char *arg, const char *what, long min)
+{
+	char *bad;
+	long val = strtol(arg, &bad, 10);
+
+	if (bad[0] != 0 || val < min) {
+		fprintf(stderr, "Bad %s %s\n", what, arg);
+		exit(1);
+	}
+	return val;
+}
+
+static int
+cmp_long(const void *a, const void *b)
+{
+	long x = *(const long *) a, y = *(const long *) b;
+
+	return x < y ? -1 : x > y;
+}
+
+/*
+ * Sleeps to absolute deadlines the way the tick loop does, with or
+ * without the real-time profile, and prints the wake-up latency
+ * distribution.
+ */
+int
+main(int argc, char **argv)
+{
+	struct server_config c;
+	struct realtime_options *rt = &c.realtime;
+	struct timeval interval = { 0, 1000 };
+	struct timespec deadline, now;
+	unsigned int count = 1000, i;
+	int log_level = LOG_NOTICE;
+	long *samples, total = 0;
+	int err, opt;
+
+	memset(&c, 0, sizeof(c));
+	rt->cpu = -1;
+	rt->stack = PCS_RT_DEFAULT_STACK;
+	while ((opt = getopt(argc, argv, "c:dhi:mn:p:r")) != -1) {
+		switch (opt) {
+		case 'c':
+			rt->cpu = parse_long(optarg, "cpu", 0);
+			rt->enabled = 1;
+			break;
+		case 'd':
+			if (log_level >= LOG_DEBUG)
+				log_level++;
+			else
+				log_level = LOG_DEBUG;
+			break;
+		case 'h':
+			usage(0);
+			break;
+		case 'i':
+			interval.tv_usec = parse_long(optarg, "interval", 1);
+			interval.tv_sec = interval.tv_usec / 1000000;
+			interval.tv_usec %= 1000000;
+			break;
+		case 'm':
+			rt->lock_memory = 1;
+			rt->enabled = 1;
+			break;
+		case 'n':
+			count = parse_long(optarg, "count", 1);
+			break;
+		case 'p':
+			rt->priority = parse_long(optarg, "priority", 1);
+			rt->enabled = 1;
+			break;
+		case 'r':
+			rt->enabled = 1;
+			break;
+		default:
+			usage(1);
+			break;
+		}
+	}
+	if (optind != argc)
+		usage(1);
+
+	log_init("tick-bench", log_level, LOG_DAEMON, 1);
+
+	samples = xcalloc(count, sizeof(*samples));
+	realtime_prepare(&c);
+	realtime_setup(&c);
+
+	pcs_clock_now(&deadline);
+	for (i = 0; i < count; i++) {
+		pcs_clock_add(&deadline, &interval);
+		do {
+			err = clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME,
+					&deadline, NULL);
+		} while (EINTR == err);
+		if (err)
+			fatal("clock_nanosleep: %s (%i)\n", strerror(err), err);
+		pcs_clock_now(&now);
+		samples[i] = pcs_clock_diff(&now, &deadline);
+		total += samples[i];
+	}
+
+	qsort(samples, count, sizeof(*samples), cmp_long);
+	printf("%u wake-ups, mean %li usec\n", count, total / count);
+	printf("latency usec: p50 %li, p90 %li, p99 %li, max %li\n",
+			samples[count / 2], samples[count * 90 / 100],
+			samples[count * 99 / 100], samples[count - 1]);
+	return 0;
+}
@@ -20,11 +20,32 @@
 #include <stdlib.h>
 #include <string.h>
 
+static int sealed;
+
+/*
+ * After this call, heap allocations through xmalloc are reported. The
+ * real-time profile seals the heap right before the first tick.
+ */
+void
+xmalloc_seal(void)
+{
+	sealed = 1;
+}
+
+static void
+check_sealed(size_t size)
+{
+	if (sealed)
+		error("heap allocation of %lu bytes after startup\n",
+				(u_long) size);
+}
+
 void *
 xmalloc(size_t size)
 {
 	void *ptr;
 
+	check_sealed(size);
 	if (size == 0)
 		fatal("xmalloc: zero size");
 	ptr = malloc(size);
@@ -46,6 +67,7 @@ xcalloc(size_t nmemb, size_t size)
 {
 	void *ptr;
 
+	check_sealed(nmemb * size);
 	if (size == 0 || nmemb == 0)
 		fatal("xcalloc: zero size");
 	if (SIZE_T_MAX / nmemb < size)
@@ -63,6 +85,7 @@ xrealloc(void *ptr, size_t nmemb, size_t size)
 	void *new_ptr;
 	size_t new_size = nmemb * size;
 
+	check_sealed(new_size);
 	if (new_size == 0)
 		fatal("xrealloc: zero size");
 	if (SIZE_T_MAX / nmemb < size)
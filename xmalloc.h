@@ -22,6 +22,7 @@ void	*xcalloc(size_t, size_t);
 void	*xrealloc(void *, size_t, size_t);
 void     xfree(void *);
 char	*xstrdup(const char *);
+void	 xmalloc_seal(void);
 
 #define XMALLOC(type, num)                                  \
 	((type *) xmalloc ((num) * sizeof(type)))